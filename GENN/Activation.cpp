@@ -0,0 +1,381 @@
+#include "pch.h"
+#include "Activation.h"
+#include "Simd.h"
+#include "FastMath.h"
+
+
+namespace cpu {
+
+
+static const char* NAMES[] = { "sigmoid", "linear", "relu", "leakyrelu", "gelu", "tanh" };
+
+// sqrt(2 / pi) of the tanh approximation of gelu
+static const float GELU_SCALE = 0.7978845608f;
+static const float GELU_CUBIC = 0.044715f;
+
+// Elements per pass of the fast-math paths that need a scratch buffer on the stack
+static const int CHUNK = 256;
+
+
+const char* activationName(Activation a) {
+    return NAMES[static_cast<int>(a)];
+}
+
+
+Activation activationFromName(const std::string& name) {
+    for (int a = 0; a <= static_cast<int>(Activation::tanh); a++) {
+        if (name == NAMES[a])
+            return static_cast<Activation>(a);
+    }
+    throw std::runtime_error("Unknown activation " + name);
+}
+
+
+bool needsPreActivation(Activation a) {
+    return a == Activation::gelu;
+}
+
+
+// relu and leakyRelu are both max(x, slope * x) with slope 0 and LEAKY_RELU_SLOPE, and
+// their derivative is 1 where the output is positive and slope elsewhere
+typedef void (*RectifyKernel)(float* x, const float* bias, float slope, int n);
+typedef void (*GradKernel)(Activation a, const float* y, float* d, float slope, int n);
+
+
+static void rectifyScalar(float* x, const float* bias, float slope, int n) {
+    for (int i = 0; i < n; i++) {
+        float v = bias != nullptr ? x[i] + bias[i] : x[i];
+        x[i] = std::max(v, slope * v);
+    }
+}
+
+
+// The activations whose derivative is a function of the output
+static void gradScalar(Activation a, const float* y, float* d, float slope, int n) {
+    switch (a) {
+    case Activation::sigmoid:
+        for (int i = 0; i < n; i++) {
+            d[i] *= y[i] * (1.0f - y[i]);
+        }
+        break;
+    case Activation::tanh:
+        for (int i = 0; i < n; i++) {
+            d[i] *= 1.0f - y[i] * y[i];
+        }
+        break;
+    default:
+        for (int i = 0; i < n; i++) {
+            d[i] *= y[i] > 0.0f ? 1.0f : slope;
+        }
+        break;
+    }
+}
+
+
+#if defined(GENN_X86)
+GENN_TARGET_AVX2 static void rectifyAvx2(float* x, const float* bias, float slope, int n) {
+    __m256 s = _mm256_set1_ps(slope);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 v = _mm256_loadu_ps(x + i);
+        if (bias != nullptr) {
+            v = _mm256_add_ps(v, _mm256_loadu_ps(bias + i));
+        }
+        _mm256_storeu_ps(x + i, _mm256_max_ps(v, _mm256_mul_ps(s, v)));
+    }
+    rectifyScalar(x + i, bias == nullptr ? nullptr : bias + i, slope, n - i);
+}
+
+
+GENN_TARGET_AVX2 static void gradAvx2(Activation a, const float* y, float* d, float slope, int n) {
+    __m256 one = _mm256_set1_ps(1.0f);
+    __m256 zero = _mm256_setzero_ps();
+    __m256 s = _mm256_set1_ps(slope);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 yi = _mm256_loadu_ps(y + i);
+        __m256 g;
+        if (a == Activation::sigmoid) {
+            g = _mm256_mul_ps(yi, _mm256_sub_ps(one, yi));
+        }
+        else if (a == Activation::tanh) {
+            g = _mm256_fnmadd_ps(yi, yi, one);
+        }
+        else {
+            g = _mm256_blendv_ps(s, one, _mm256_cmp_ps(yi, zero, _CMP_GT_OQ));
+        }
+        _mm256_storeu_ps(d + i, _mm256_mul_ps(_mm256_loadu_ps(d + i), g));
+    }
+    gradScalar(a, y + i, d + i, slope, n - i);
+}
+
+
+GENN_TARGET_AVX512 static void rectifyAvx512(float* x, const float* bias, float slope, int n) {
+    __m512 s = _mm512_set1_ps(slope);
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512 v = _mm512_loadu_ps(x + i);
+        if (bias != nullptr) {
+            v = _mm512_add_ps(v, _mm512_loadu_ps(bias + i));
+        }
+        _mm512_storeu_ps(x + i, _mm512_max_ps(v, _mm512_mul_ps(s, v)));
+    }
+    rectifyScalar(x + i, bias == nullptr ? nullptr : bias + i, slope, n - i);
+}
+
+
+GENN_TARGET_AVX512 static void gradAvx512(Activation a, const float* y, float* d, float slope, int n) {
+    __m512 one = _mm512_set1_ps(1.0f);
+    __m512 zero = _mm512_setzero_ps();
+    __m512 s = _mm512_set1_ps(slope);
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512 yi = _mm512_loadu_ps(y + i);
+        __m512 g;
+        if (a == Activation::sigmoid) {
+            g = _mm512_mul_ps(yi, _mm512_sub_ps(one, yi));
+        }
+        else if (a == Activation::tanh) {
+            g = _mm512_fnmadd_ps(yi, yi, one);
+        }
+        else {
+            g = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(yi, zero, _CMP_GT_OQ), s, one);
+        }
+        _mm512_storeu_ps(d + i, _mm512_mul_ps(_mm512_loadu_ps(d + i), g));
+    }
+    gradScalar(a, y + i, d + i, slope, n - i);
+}
+#endif // GENN_X86
+
+
+static RectifyKernel selectRectify() {
+    switch (simd::level()) {
+#if defined(GENN_X86)
+    case simd::avx512:
+        return rectifyAvx512;
+    case simd::avx2:
+        return rectifyAvx2;
+#endif // GENN_X86
+    default:
+        return rectifyScalar;
+    }
+}
+
+
+static GradKernel selectGrad() {
+    switch (simd::level()) {
+#if defined(GENN_X86)
+    case simd::avx512:
+        return gradAvx512;
+    case simd::avx2:
+        return gradAvx2;
+#endif // GENN_X86
+    default:
+        return gradScalar;
+    }
+}
+
+
+static float geluOf(float x) {
+    return 0.5f * x * (1.0f + tanhf(GELU_SCALE * (x + GELU_CUBIC * x * x * x)));
+}
+
+
+static float geluGradOf(float x) {
+    float x2 = x * x;
+    float t = tanhf(GELU_SCALE * (x + GELU_CUBIC * x * x2));
+    return 0.5f * (1.0f + t) + 0.5f * x * (1.0f - t * t) * GELU_SCALE * (1.0f + 3.0f * GELU_CUBIC * x2);
+}
+
+
+static void addBias(float* x, const float* bias, int n) {
+    for (int i = 0; bias != nullptr && i < n; i++) {
+        x[i] += bias[i];
+    }
+}
+
+
+static void geluFast(float* x, int n) {
+    float t[CHUNK];
+    for (int c = 0; c < n; c += CHUNK) {
+        int k = std::min(CHUNK, n - c);
+        float* v = x + c;
+        for (int i = 0; i < k; i++) {
+            t[i] = GELU_SCALE * (v[i] + GELU_CUBIC * v[i] * v[i] * v[i]);
+        }
+        fastmath::tanh(t, t, k);
+        for (int i = 0; i < k; i++) {
+            v[i] = 0.5f * v[i] * (1.0f + t[i]);
+        }
+    }
+}
+
+
+static void geluGradFast(const float* z, float* d, int n) {
+    float t[CHUNK];
+    for (int c = 0; c < n; c += CHUNK) {
+        int k = std::min(CHUNK, n - c);
+        const float* v = z + c;
+        for (int i = 0; i < k; i++) {
+            t[i] = GELU_SCALE * (v[i] + GELU_CUBIC * v[i] * v[i] * v[i]);
+        }
+        fastmath::tanh(t, t, k);
+        for (int i = 0; i < k; i++) {
+            float x2 = v[i] * v[i];
+            d[c + i] *= 0.5f * (1.0f + t[i]) + 0.5f * v[i] * (1.0f - t[i] * t[i]) * GELU_SCALE * (1.0f + 3.0f * GELU_CUBIC * x2);
+        }
+    }
+}
+
+
+void activate(Activation a, float* x, int n) {
+    activate(a, x, nullptr, n);
+}
+
+
+void activate(Activation a, float* x, const float* bias, int n) {
+    bool fast = fastmath::enabled();
+    switch (a) {
+    case Activation::sigmoid:
+        if (fast) {
+            addBias(x, bias, n);
+            fastmath::sigmoid(x, x, n);
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            float v = bias != nullptr ? x[i] + bias[i] : x[i];
+            x[i] = 1.0f / (1.0f + expf(-v));
+        }
+        break;
+    case Activation::relu:
+        selectRectify()(x, bias, 0.0f, n);
+        break;
+    case Activation::leakyRelu:
+        selectRectify()(x, bias, LEAKY_RELU_SLOPE, n);
+        break;
+    case Activation::gelu:
+        if (fast) {
+            addBias(x, bias, n);
+            geluFast(x, n);
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            x[i] = geluOf(bias != nullptr ? x[i] + bias[i] : x[i]);
+        }
+        break;
+    case Activation::tanh:
+        if (fast) {
+            addBias(x, bias, n);
+            fastmath::tanh(x, x, n);
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            x[i] = tanhf(bias != nullptr ? x[i] + bias[i] : x[i]);
+        }
+        break;
+    default:
+        addBias(x, bias, n);
+        break;
+    }
+}
+
+
+void gradActivation(Activation a, const float* z, const float* y, float* d, int n) {
+    switch (a) {
+    case Activation::linear:
+        break;
+    case Activation::gelu:
+        if (fastmath::enabled()) {
+            geluGradFast(z, d, n);
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            d[i] *= geluGradOf(z[i]);
+        }
+        break;
+    default:
+        selectGrad()(a, y, d, a == Activation::leakyRelu ? LEAKY_RELU_SLOPE : 0.0f, n);
+        break;
+    }
+}
+
+
+// y = exp(x - m)
+static void shiftedExp(const float* x, float m, float* y, int n) {
+    if (fastmath::enabled()) {
+        for (int i = 0; i < n; i++) {
+            y[i] = x[i] - m;
+        }
+        fastmath::exp(y, y, n);
+        return;
+    }
+    for (int i = 0; i < n; i++) {
+        y[i] = expf(x[i] - m);
+    }
+}
+
+
+static float logOf(float x) {
+    if (fastmath::enabled()) {
+        fastmath::log(&x, &x, 1);
+        return x;
+    }
+    return logf(x);
+}
+
+
+void softmax(const float* x, float* y, int n) {
+    float m = *std::max_element(x, x + n);
+    shiftedExp(x, m, y, n);
+    float sum = 0.0f;
+    for (int i = 0; i < n; i++) {
+        sum += y[i];
+    }
+    float inv = 1.0f / sum;
+    for (int i = 0; i < n; i++) {
+        y[i] *= inv;
+    }
+}
+
+
+float crossEntropySoftmax(const float* logits, int n, int label) {
+    float m = *std::max_element(logits, logits + n);
+    float e[CHUNK];
+    float sum = 0.0f;
+    for (int c = 0; c < n; c += CHUNK) {
+        int k = std::min(CHUNK, n - c);
+        shiftedExp(logits + c, m, e, k);
+        for (int i = 0; i < k; i++) {
+            sum += e[i];
+        }
+    }
+    return logOf(sum) - (logits[label] - m);
+}
+
+
+float softmaxCrossEntropy(const float* logits, int n, int label, float* dLogits, int* argmax) {
+    int am = 0;
+    float m = logits[0];
+    for (int i = 1; i < n; i++) {
+        if (logits[i] > m) {
+            am = i;
+            m = logits[i];
+        }
+    }
+    shiftedExp(logits, m, dLogits, n);
+    float sum = 0.0f;
+    for (int i = 0; i < n; i++) {
+        sum += dLogits[i];
+    }
+    float inv = 1.0f / sum;
+    for (int i = 0; i < n; i++) {
+        dLogits[i] *= inv;
+    }
+    dLogits[label] -= 1.0f;
+    if (argmax != nullptr)
+        *argmax = am;
+    return logOf(sum) - (logits[label] - m);
+}
+
+
+}
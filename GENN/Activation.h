@@ -0,0 +1,36 @@
+#pragma once
+
+#include <string>
+
+
+namespace cpu {
+
+
+// The values are stored in checkpoints, so new activations go at the end
+enum class Activation { sigmoid, linear, relu, leakyRelu, gelu, tanh };
+
+// Slope of leakyRelu below zero
+const float LEAKY_RELU_SLOPE = 0.01f;
+
+const char* activationName(Activation a);
+// Inverse of activationName; throws on unknown names
+Activation activationFromName(const std::string& name);
+// gelu's derivative cannot be recovered from its output, so its layers also keep the
+// pre-activation for gradActivation
+bool needsPreActivation(Activation a);
+
+void activate(Activation a, float* x, int n);
+// x = a(x + bias)
+void activate(Activation a, float* x, const float* bias, int n);
+// d *= a'(z), expressed through the activation output y; the pre-activation z is only
+// read when needsPreActivation(a)
+void gradActivation(Activation a, const float* z, const float* y, float* d, int n);
+
+void softmax(const float* x, float* y, int n);
+float crossEntropySoftmax(const float* logits, int n, int label);
+// Max-subtracted softmax cross-entropy in one pass: returns the loss, writes
+// dLogits = softmax(logits) - onehot(label) and the index of the largest logit
+float softmaxCrossEntropy(const float* logits, int n, int label, float* dLogits, int* argmax);
+
+
+}
@@ -0,0 +1,83 @@
+#include "pch.h"
+#include "Arena.h"
+
+#if defined(_MSC_VER)
+#include <malloc.h>
+#endif
+
+
+namespace cpu {
+
+
+void* alignedAlloc(size_t bytes) {
+    bytes = (bytes + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+#if defined(_MSC_VER)
+    void* p = _aligned_malloc(bytes == 0 ? ALIGNMENT : bytes, ALIGNMENT);
+#else
+    void* p = nullptr;
+    if (posix_memalign(&p, ALIGNMENT, bytes == 0 ? ALIGNMENT : bytes) != 0)
+        p = nullptr;
+#endif
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+
+void alignedFree(void* p) {
+#if defined(_MSC_VER)
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
+
+
+Arena::Arena(size_t floats) : cap(padded(floats)) {
+    base = static_cast<float*>(alignedAlloc(cap * sizeof(float)));
+    memset(base, 0, cap * sizeof(float));
+}
+
+
+Arena::Arena(Arena&& a) noexcept : base(a.base), cap(a.cap), top(a.top) {
+    a.base = nullptr;
+    a.cap = 0;
+    a.top = 0;
+}
+
+
+Arena& Arena::operator=(Arena&& a) noexcept {
+    if (this != &a) {
+        alignedFree(base);
+        base = a.base;
+        cap = a.cap;
+        top = a.top;
+        a.base = nullptr;
+        a.cap = 0;
+        a.top = 0;
+    }
+    return *this;
+}
+
+
+Arena::~Arena() {
+    alignedFree(base);
+}
+
+
+float* Arena::allocate(size_t n) {
+    size_t size = padded(n);
+    if (top + size > cap)
+        throw std::runtime_error("Arena exhausted. Capacity: " + std::to_string(cap) + ", requested: " + std::to_string(top + size));
+    float* p = base + top;
+    top += size;
+    return p;
+}
+
+
+void Arena::reset() {
+    top = 0;
+}
+
+
+}
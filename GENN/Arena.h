@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+
+
+namespace cpu {
+
+
+const size_t ALIGNMENT = 64;
+
+void* alignedAlloc(size_t bytes);
+void alignedFree(void* p);
+
+
+// One zero-filled, 64-byte aligned block handed out by bump allocation; every
+// allocation starts on an ALIGNMENT boundary so views into it suit aligned SIMD loads.
+class Arena {
+public:
+    Arena() = default;
+    explicit Arena(size_t floats);
+    Arena(const Arena&) = delete;
+    Arena& operator= (const Arena&) = delete;
+    Arena(Arena&& a) noexcept;
+    Arena& operator= (Arena&& a) noexcept;
+    ~Arena();
+
+    float* allocate(size_t n);
+    void reset();
+
+    size_t capacity() const { return cap; }
+    size_t used() const { return top; }
+
+    static size_t padded(size_t n) { return (n + ALIGNMENT / sizeof(float) - 1) / (ALIGNMENT / sizeof(float)) * (ALIGNMENT / sizeof(float)); }
+
+private:
+    float* base = nullptr;
+    size_t cap = 0;
+    size_t top = 0;
+};
+
+
+}
@@ -0,0 +1,342 @@
+#include "pch.h"
+#include "Checkpoint.h"
+#include <cmath>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+namespace nn {
+
+
+static const char MAGIC[8] = { 'G', 'E', 'N', 'N', 'C', 'K', 'P', 'T' };
+static const size_t SECTION_ALIGNMENT = 64;
+static const size_t NAME_SIZE = 32;
+
+
+// Version 1 ends after optimizer, which it reserved as 0
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t fileSize;
+    uint64_t position;
+    uint32_t seed;
+    uint32_t layerCount;
+    uint32_t tensorCount;
+    int32_t batchSize;
+    float rate;
+    float mean;
+    float std;
+    // 0 for none, else OptimizerConfig::Kind + 1
+    uint32_t optimizer;
+    uint64_t steps;
+    uint32_t schedule;
+    // 1 for nesterov, 2 for decoupled
+    uint32_t flags;
+    int64_t warmup;
+    int64_t period;
+    float gamma;
+    float minimum;
+    float weightDecay;
+    float momentum;
+    float beta1;
+    float beta2;
+    float epsilon;
+    uint32_t reserved;
+};
+static_assert(sizeof(Header) == 128, "Checkpoint header must be 128 bytes");
+static const size_t HEADER_SIZE_V1 = 64;
+
+
+struct LayerRecord {
+    int32_t in;
+    int32_t out;
+    int32_t activation;
+    int32_t isOutput;
+};
+
+
+struct TensorRecord {
+    char name[NAME_SIZE];
+    uint64_t offset;
+    uint64_t count;
+};
+
+
+static size_t aligned(size_t n) {
+    return (n + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+}
+
+
+std::string weightName(int layer) {
+    return "layer" + std::to_string(layer) + ".W";
+}
+
+
+std::string biasName(int layer) {
+    return "layer" + std::to_string(layer) + ".b";
+}
+
+
+void CheckpointBuilder::addLayer(const cpu::DenseLayer& layer) {
+    int index = static_cast<int>(layers.size());
+    layers.push_back({ layer.inSize, layer.outSize, layer.activation, layer.isOutput });
+
+    std::vector<float> W(static_cast<size_t>(layer.outSize) * layer.inSize);
+    for (int i = 0; i < layer.outSize; i++) {
+        memcpy(&W[static_cast<size_t>(i) * layer.inSize], layer.W.row(i), layer.inSize * sizeof(float));
+    }
+    tensors.emplace_back(weightName(index), std::move(W));
+    addTensor(biasName(index), layer.b.data, layer.outSize);
+}
+
+
+void CheckpointBuilder::addTensor(const std::string& name, const float* data, size_t count) {
+    if (name.empty() || name.size() >= NAME_SIZE)
+        throw std::runtime_error("Checkpoint tensor names must have 1 to " + std::to_string(NAME_SIZE - 1) + " characters: " + name);
+    tensors.emplace_back(name, std::vector<float>(data, data + count));
+}
+
+
+std::vector<uint8_t> CheckpointBuilder::serialize() const {
+    size_t tables = sizeof(Header) + layers.size() * sizeof(LayerRecord) + tensors.size() * sizeof(TensorRecord);
+    size_t size = aligned(tables);
+    std::vector<TensorRecord> records(tensors.size());
+    for (size_t i = 0; i < tensors.size(); i++) {
+        memset(&records[i], 0, sizeof(TensorRecord));
+        memcpy(records[i].name, tensors[i].first.data(), tensors[i].first.size());
+        records[i].offset = size;
+        records[i].count = tensors[i].second.size();
+        size = aligned(size + tensors[i].second.size() * sizeof(float));
+    }
+
+    Header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, MAGIC, sizeof(MAGIC));
+    h.version = Checkpoint::version;
+    h.headerSize = sizeof(Header);
+    h.fileSize = size;
+    h.position = static_cast<uint64_t>(state.position);
+    h.seed = state.seed;
+    h.layerCount = static_cast<uint32_t>(layers.size());
+    h.tensorCount = static_cast<uint32_t>(tensors.size());
+    h.batchSize = state.batchSize;
+    h.mean = state.normalization.mean;
+    h.std = state.normalization.std;
+    if (state.hasOptimizer) {
+        const cpu::OptimizerConfig& o = state.optimizer;
+        h.optimizer = static_cast<uint32_t>(o.kind) + 1;
+        h.steps = static_cast<uint64_t>(state.optimizerSteps);
+        h.rate = o.schedule.rate;
+        h.schedule = static_cast<uint32_t>(o.schedule.kind);
+        h.flags = (o.nesterov ? 1 : 0) | (o.decoupled ? 2 : 0);
+        h.warmup = o.schedule.warmup;
+        h.period = o.schedule.period;
+        h.gamma = o.schedule.gamma;
+        h.minimum = o.schedule.minimum;
+        h.weightDecay = o.weightDecay;
+        h.momentum = o.momentum;
+        h.beta1 = o.beta1;
+        h.beta2 = o.beta2;
+        h.epsilon = o.epsilon;
+    }
+
+    std::vector<uint8_t> bytes(size, 0);
+    uint8_t* p = bytes.data();
+    memcpy(p, &h, sizeof(h));
+    p += sizeof(h);
+    for (auto& layer : layers) {
+        LayerRecord r = { layer.in, layer.out, static_cast<int32_t>(layer.activation), layer.isOutput ? 1 : 0 };
+        memcpy(p, &r, sizeof(r));
+        p += sizeof(r);
+    }
+    if (!records.empty()) {
+        memcpy(p, records.data(), records.size() * sizeof(TensorRecord));
+    }
+    for (size_t i = 0; i < tensors.size(); i++) {
+        if (!tensors[i].second.empty()) {
+            memcpy(bytes.data() + records[i].offset, tensors[i].second.data(), tensors[i].second.size() * sizeof(float));
+        }
+    }
+    return bytes;
+}
+
+
+#ifdef _WIN32
+static std::wstring widen(const std::string& s) {
+    std::wstring w(MultiByteToWideChar(CP_UTF8, 0, s.c_str(), -1, nullptr, 0), L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, s.c_str(), -1, &w[0], (int)w.size());
+    return w;
+}
+
+
+void writeFileAtomic(const std::string& filename, const std::vector<uint8_t>& bytes) {
+    std::string temp = filename + ".tmp";
+    std::wstring wtemp = widen(temp);
+    HANDLE file = CreateFile2(wtemp.c_str(), GENERIC_WRITE, 0, CREATE_ALWAYS, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        throw std::runtime_error("Cannot create " + temp);
+
+    bool ok = true;
+    size_t done = 0;
+    while (ok && done < bytes.size()) {
+        DWORD written = 0;
+        DWORD n = static_cast<DWORD>(std::min<size_t>(bytes.size() - done, 1 << 30));
+        ok = WriteFile(file, bytes.data() + done, n, &written, nullptr) != 0;
+        done += written;
+    }
+    ok = ok && FlushFileBuffers(file) != 0;
+    CloseHandle(file);
+    if (!ok || !MoveFileExW(wtemp.c_str(), widen(filename).c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+        DeleteFileW(wtemp.c_str());
+        throw std::runtime_error("Cannot write " + filename);
+    }
+}
+#else
+void writeFileAtomic(const std::string& filename, const std::vector<uint8_t>& bytes) {
+    std::string temp = filename + ".tmp";
+    int fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        throw std::runtime_error("Cannot create " + temp);
+
+    bool ok = true;
+    size_t done = 0;
+    while (ok && done < bytes.size()) {
+        ssize_t n = write(fd, bytes.data() + done, bytes.size() - done);
+        ok = n > 0;
+        done += ok ? static_cast<size_t>(n) : 0;
+    }
+    ok = ok && fsync(fd) == 0;
+    ok = close(fd) == 0 && ok;
+    if (!ok || rename(temp.c_str(), filename.c_str()) != 0) {
+        unlink(temp.c_str());
+        throw std::runtime_error("Cannot write " + filename);
+    }
+
+    // The rename is only durable once the directory entry is; EINVAL means the file
+    // system does not sync directories
+    size_t slash = filename.find_last_of('/');
+    std::string dir = slash == std::string::npos ? "." : slash == 0 ? "/" : filename.substr(0, slash);
+    int dirFd = open(dir.c_str(), O_RDONLY);
+    ok = dirFd >= 0 && (fsync(dirFd) == 0 || errno == EINVAL);
+    if (dirFd >= 0)
+        close(dirFd);
+    if (!ok)
+        throw std::runtime_error("Cannot sync the directory of " + filename);
+}
+#endif
+
+
+Checkpoint::Checkpoint(const std::string& filename) : filename(filename), file(filename) {
+    const uint8_t* p = file.data();
+    size_t size = file.size();
+    Header h;
+    memset(&h, 0, sizeof(h));
+    if (size < HEADER_SIZE_V1 || memcmp(p, MAGIC, sizeof(MAGIC)) != 0)
+        throw std::runtime_error(filename + " is not a checkpoint");
+    memcpy(&h, p, HEADER_SIZE_V1);
+    if (h.version != 1 && h.version != version)
+        throw std::runtime_error(filename + " has checkpoint version " + std::to_string(h.version) + ", expected 1 or " + std::to_string(version));
+    size_t headerSize = h.version == 1 ? HEADER_SIZE_V1 : sizeof(Header);
+    if (h.headerSize != headerSize || h.fileSize != size || size < headerSize)
+        throw std::runtime_error(filename + " is truncated: header records " + std::to_string(h.fileSize) + " bytes, file has " + std::to_string(size));
+    memcpy(&h, p, headerSize);
+    if (static_cast<uint64_t>(headerSize) + static_cast<uint64_t>(h.layerCount) * sizeof(LayerRecord) +
+            static_cast<uint64_t>(h.tensorCount) * sizeof(TensorRecord) > size)
+        throw std::runtime_error(filename + " has truncated layer or tensor tables");
+    if (h.batchSize <= 0 || !std::isfinite(h.rate))
+        throw std::runtime_error(filename + " has an invalid batch size or learning rate");
+    if (!std::isfinite(h.mean) || !std::isfinite(h.std) || h.std <= 0.0f)
+        throw std::runtime_error(filename + " has an invalid input normalization");
+    if (h.version == 1 && h.optimizer != 0)
+        throw std::runtime_error(filename + " has a nonzero reserved header field");
+    if (h.optimizer > static_cast<uint32_t>(cpu::OptimizerConfig::adam) + 1 || h.steps > static_cast<uint64_t>(INT64_MAX) ||
+            h.schedule > static_cast<uint32_t>(cpu::LearningRateSchedule::cosine) || h.warmup < 0 || h.period < 0 ||
+            !std::isfinite(h.gamma) || !std::isfinite(h.minimum) || !std::isfinite(h.weightDecay) || !std::isfinite(h.momentum) ||
+            !std::isfinite(h.beta1) || !std::isfinite(h.beta2) || !std::isfinite(h.epsilon))
+        throw std::runtime_error(filename + " has invalid optimizer settings");
+
+    training.position = static_cast<long long>(h.position);
+    training.seed = h.seed;
+    training.batchSize = h.batchSize;
+    training.normalization.mean = h.mean;
+    training.normalization.std = h.std;
+    if (h.optimizer != 0) {
+        cpu::OptimizerConfig& o = training.optimizer;
+        training.hasOptimizer = true;
+        training.optimizerSteps = static_cast<long long>(h.steps);
+        o.kind = static_cast<cpu::OptimizerConfig::Kind>(h.optimizer - 1);
+        o.schedule.kind = static_cast<cpu::LearningRateSchedule::Kind>(h.schedule);
+        o.schedule.rate = h.rate;
+        o.schedule.warmup = h.warmup;
+        o.schedule.period = h.period;
+        o.schedule.gamma = h.gamma;
+        o.schedule.minimum = h.minimum;
+        o.weightDecay = h.weightDecay;
+        o.momentum = h.momentum;
+        o.nesterov = (h.flags & 1) != 0;
+        o.decoupled = (h.flags & 2) != 0;
+        o.beta1 = h.beta1;
+        o.beta2 = h.beta2;
+        o.epsilon = h.epsilon;
+    }
+
+    const uint8_t* q = p + headerSize;
+    for (uint32_t i = 0; i < h.layerCount; i++, q += sizeof(LayerRecord)) {
+        LayerRecord r;
+        memcpy(&r, q, sizeof(r));
+        if (r.in <= 0 || r.out <= 0 || r.activation < 0 || r.activation > static_cast<int32_t>(cpu::Activation::tanh))
+            throw std::runtime_error(filename + " has an invalid layer " + std::to_string(i));
+        if (i > 0 && r.in != topology.back().out)
+            throw std::runtime_error(filename + ": layer " + std::to_string(i) + " expects " + std::to_string(r.in) +
+                " inputs but receives " + std::to_string(topology.back().out));
+        topology.push_back({ r.in, r.out, static_cast<cpu::Activation>(r.activation), r.isOutput != 0 });
+    }
+
+    for (uint32_t i = 0; i < h.tensorCount; i++, q += sizeof(TensorRecord)) {
+        TensorRecord r;
+        memcpy(&r, q, sizeof(r));
+        if (r.name[NAME_SIZE - 1] != '\0')
+            throw std::runtime_error(filename + " has an unterminated tensor name");
+        if (r.offset % SECTION_ALIGNMENT != 0 || r.offset > size || r.count > (size - r.offset) / sizeof(float))
+            throw std::runtime_error(filename + ": tensor " + r.name + " lies outside the file");
+        tensors.push_back({ r.name, reinterpret_cast<const float*>(p + r.offset), static_cast<size_t>(r.count) });
+    }
+
+    for (int i = 0; i < (int)topology.size(); i++) {
+        tensor(weightName(i), static_cast<size_t>(topology[i].out) * topology[i].in);
+        tensor(biasName(i), topology[i].out);
+    }
+    if (h.version == 1 && has("optimizer.steps")) {
+        memcpy(&training.optimizerSteps, tensor("optimizer.steps", 2), sizeof(training.optimizerSteps));
+        training.optimizerSteps = std::max(0LL, training.optimizerSteps);
+    }
+}
+
+
+bool Checkpoint::has(const std::string& name) const {
+    for (auto& t : tensors) {
+        if (t.name == name)
+            return true;
+    }
+    return false;
+}
+
+
+const float* Checkpoint::tensor(const std::string& name, size_t count) const {
+    for (auto& t : tensors) {
+        if (t.name != name)
+            continue;
+        if (t.count != count)
+            throw std::runtime_error(filename + ": tensor " + name + " holds " + std::to_string(t.count) + " values, expected " + std::to_string(count));
+        return t.data;
+    }
+    throw std::runtime_error(filename + " has no tensor " + name);
+}
+
+
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Activation.h"
+#include "Dataset.h"
+#include "DenseLayer.h"
+#include "Optimizer.h"
+#include "reader.h"
+
+
+namespace nn {
+
+
+// Everything besides the tensors that a run needs to continue where it stopped. The
+// data order and augmentation are functions of seed and position, so these two stand
+// in for the random generator state.
+struct TrainingState {
+    long long position = 0;
+    unsigned int seed = 0;
+    int batchSize = 0;
+    Normalization normalization;
+    // The optimizer whose moments the checkpoint holds and its step count; hasOptimizer is
+    // false when none had been made yet, and in version 1 files
+    bool hasOptimizer = false;
+    cpu::OptimizerConfig optimizer;
+    long long optimizerSteps = 0;
+};
+
+
+struct CheckpointLayer {
+    int in;
+    int out;
+    cpu::Activation activation;
+    bool isOutput;
+};
+
+
+std::string weightName(int layer);
+std::string biasName(int layer);
+
+
+// Checkpoint file, version 2, little-endian:
+//   128-byte header: "GENNCKPT", version, header size, file size, position, seed, layer
+//                    and tensor counts, batch size, base learning rate, normalization,
+//                    optimizer kind, step count and hyperparameters
+//   layer table:     in, out, activation, output flag as int32 each
+//   tensor table:    32-byte zero-padded name, byte offset and float count as uint64
+//   tensor data:     float32 arrays, each starting on a 64-byte boundary
+// Layer i stores "layer<i>.W" (out x in, row-major) and "layer<i>.b", named by
+// weightName/biasName; other state such as the optimizer's is stored as further tensors.
+// Version 1 files are still read: their header is the first 64 bytes, without the
+// optimizer, and they store its step count in the tensor "optimizer.steps".
+class CheckpointBuilder {
+public:
+    explicit CheckpointBuilder(const TrainingState& state) : state(state) {}
+
+    // Copies the layer's parameters, so the builder is a snapshot that can be
+    // serialized on another thread while training continues
+    void addLayer(const cpu::DenseLayer& layer);
+    void addTensor(const std::string& name, const float* data, size_t count);
+
+    std::vector<uint8_t> serialize() const;
+
+private:
+    TrainingState state;
+    std::vector<CheckpointLayer> layers;
+    std::vector<std::pair<std::string, std::vector<float>>> tensors;
+};
+
+
+// Writes to a temporary file next to filename, flushes it to disk and renames it over
+// filename, so readers see either the previous checkpoint or the complete new one
+void writeFileAtomic(const std::string& filename, const std::vector<uint8_t>& bytes);
+
+
+// Read-only view of a checkpoint file. The file is memory-mapped and validated up
+// front; tensors are served in place from the mapping.
+class Checkpoint {
+public:
+    static const uint32_t version = 2;
+
+    explicit Checkpoint(const std::string& filename);
+
+    const TrainingState& state() const { return training; }
+    const std::vector<CheckpointLayer>& layers() const { return topology; }
+
+    bool has(const std::string& name) const;
+    // The named tensor, which must hold exactly count floats
+    const float* tensor(const std::string& name, size_t count) const;
+
+private:
+    struct Tensor {
+        std::string name;
+        const float* data;
+        size_t count;
+    };
+
+    std::string filename;
+    MappedFile file;
+    TrainingState training;
+    std::vector<CheckpointLayer> topology;
+    std::vector<Tensor> tensors;
+};
+
+
+}
@@ -0,0 +1,170 @@
+#include "pch.h"
+#include "Dataset.h"
+#include "Simd.h"
+#include <cmath>
+
+
+namespace nn {
+
+
+typedef void(*NormalizeKernel)(const uint8_t* src, float* dst, int n, float scale, float shift);
+
+
+static void normalizeScalar(const uint8_t* src, float* dst, int n, float scale, float shift) {
+    for (int i = 0; i < n; i++) {
+        dst[i] = src[i] * scale + shift;
+    }
+}
+
+
+#if defined(GENN_X86)
+GENN_TARGET_AVX2 static void normalizeAvx2(const uint8_t* src, float* dst, int n, float scale, float shift) {
+    __m256 s = _mm256_set1_ps(scale);
+    __m256 t = _mm256_set1_ps(shift);
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        __m128i lo = _mm256_castsi256_si128(bytes);
+        __m128i hi = _mm256_extracti128_si256(bytes, 1);
+        _mm256_storeu_ps(dst + i, _mm256_fmadd_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(lo)), s, t));
+        _mm256_storeu_ps(dst + i + 8, _mm256_fmadd_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(lo, 8))), s, t));
+        _mm256_storeu_ps(dst + i + 16, _mm256_fmadd_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(hi)), s, t));
+        _mm256_storeu_ps(dst + i + 24, _mm256_fmadd_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(hi, 8))), s, t));
+    }
+    for (; i + 8 <= n; i += 8) {
+        __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i));
+        _mm256_storeu_ps(dst + i, _mm256_fmadd_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes)), s, t));
+    }
+    normalizeScalar(src + i, dst + i, n - i, scale, shift);
+}
+
+
+GENN_TARGET_AVX512 static void normalizeAvx512(const uint8_t* src, float* dst, int n, float scale, float shift) {
+    __m512 s = _mm512_set1_ps(scale);
+    __m512 t = _mm512_set1_ps(shift);
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm512_storeu_ps(dst + i, _mm512_fmadd_ps(_mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(bytes)), s, t));
+    }
+    normalizeScalar(src + i, dst + i, n - i, scale, shift);
+}
+#endif
+
+
+static NormalizeKernel selectNormalize() {
+#if defined(GENN_X86)
+    switch (cpu::simd::level()) {
+    case cpu::simd::avx512:
+        return normalizeAvx512;
+    case cpu::simd::avx2:
+        return normalizeAvx2;
+    default:
+        break;
+    }
+#endif
+    return normalizeScalar;
+}
+
+
+void normalizePixels(const uint8_t* src, float* dst, int n, const Normalization& norm) {
+    selectNormalize()(src, dst, n, 1.0f / (255.0f * norm.std), -norm.mean / norm.std);
+}
+
+
+ImageSet::ImageSet(std::shared_ptr<const IdxFile> file) {
+    if (file->dims() != 3)
+        throw std::runtime_error("Image file must have 3 dimensions, got " + std::to_string(file->dims()));
+    data = file->data();
+    n = file->count();
+    h = file->dim(1);
+    w = file->dim(2);
+    owner = std::move(file);
+}
+
+
+ImageSet::ImageSet(const std::vector<cpu::Matrix>& images) {
+    n = static_cast<int>(images.size());
+    h = images.empty() ? 0 : images[0].h;
+    w = images.empty() ? 0 : images[0].w;
+    auto storage = std::make_shared<std::vector<uint8_t>>(static_cast<size_t>(n) * pixels());
+    for (int i = 0; i < n; i++) {
+        if (images[i].h != h || images[i].w != w)
+            throw std::runtime_error("Images differ in size at index " + std::to_string(i));
+        uint8_t* dst = storage->data() + static_cast<size_t>(i) * pixels();
+        for (int j = 0; j < pixels(); j++) {
+            dst[j] = static_cast<uint8_t>(std::min(255.0f, std::max(0.0f, images[i].data[j] + 0.5f)));
+        }
+    }
+    data = storage->data();
+    owner = std::move(storage);
+}
+
+
+Normalization ImageSet::measure() const {
+    std::vector<long long> histogram(256, 0);
+    size_t total = static_cast<size_t>(n) * pixels();
+    for (size_t i = 0; i < total; i++) {
+        ++histogram[data[i]];
+    }
+    double sum = 0.0;
+    double sumSq = 0.0;
+    for (int v = 0; v < 256; v++) {
+        double x = v / 255.0;
+        sum += histogram[v] * x;
+        sumSq += histogram[v] * x * x;
+    }
+    Normalization r;
+    if (total > 0) {
+        double mean = sum / total;
+        r.mean = static_cast<float>(mean);
+        r.std = static_cast<float>(std::sqrt(std::max(sumSq / total - mean * mean, 1e-12)));
+    }
+    return r;
+}
+
+
+void ImageSet::normalize(int i, const Normalization& norm, float* dst) const {
+    normalizePixels(image(i), dst, pixels(), norm);
+}
+
+
+static void checkWidth(cpu::MatrixView dst, int pixels) {
+    if (dst.w != pixels)
+        throw std::runtime_error("Images have " + std::to_string(pixels) + " pixels but the destination has " + std::to_string(dst.w) + " columns");
+}
+
+
+void ImageSet::normalize(int first, int count, const Normalization& norm, cpu::MatrixView dst) const {
+    checkWidth(dst, pixels());
+    NormalizeKernel kernel = selectNormalize();
+    float scale = 1.0f / (255.0f * norm.std);
+    float shift = -norm.mean / norm.std;
+    for (int i = 0; i < count; i++) {
+        kernel(image(first + i), dst.row(i), pixels(), scale, shift);
+    }
+}
+
+
+void ImageSet::normalize(const int* rows, int count, const Normalization& norm, cpu::MatrixView dst) const {
+    checkWidth(dst, pixels());
+    NormalizeKernel kernel = selectNormalize();
+    float scale = 1.0f / (255.0f * norm.std);
+    float shift = -norm.mean / norm.std;
+    for (int i = 0; i < count; i++) {
+        kernel(image(rows[i]), dst.row(i), pixels(), scale, shift);
+    }
+}
+
+
+cpu::Matrix ImageSet::toMatrix(int i) const {
+    cpu::Matrix m(h, w);
+    const uint8_t* src = image(i);
+    for (int j = 0; j < pixels(); j++) {
+        m.data[j] = src[j];
+    }
+    return m;
+}
+
+
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "Matrix.h"
+#include "reader.h"
+
+
+namespace nn {
+
+
+// Maps a pixel x in 0-255 to (x / 255 - mean) / std
+struct Normalization {
+    float mean = 0.1307f;
+    float std = 0.3081f;
+};
+
+
+void normalizePixels(const uint8_t* src, float* dst, int n, const Normalization& norm);
+
+
+// Images as rows of raw uint8 pixels, either borrowed from a mapped IDX file or owned.
+// Copies share the storage; rows are normalized into float buffers only when consumed.
+class ImageSet {
+public:
+    ImageSet() = default;
+    explicit ImageSet(std::shared_ptr<const IdxFile> file);
+    explicit ImageSet(const std::vector<cpu::Matrix>& images);
+
+    int size() const { return n; }
+    int rows() const { return h; }
+    int cols() const { return w; }
+    int pixels() const { return h * w; }
+
+    const uint8_t* image(int i) const { return data + static_cast<size_t>(i) * pixels(); }
+
+    // Pixel mean and standard deviation on the 0-1 scale
+    Normalization measure() const;
+
+    void normalize(int i, const Normalization& norm, float* dst) const;
+    void normalize(int first, int count, const Normalization& norm, cpu::MatrixView dst) const;
+    void normalize(const int* rows, int count, const Normalization& norm, cpu::MatrixView dst) const;
+
+    // Raw 0-255 values, for display
+    cpu::Matrix toMatrix(int i) const;
+
+private:
+    std::shared_ptr<const void> owner;
+    const uint8_t* data = nullptr;
+    int n = 0;
+    int h = 0;
+    int w = 0;
+};
+
+
+}
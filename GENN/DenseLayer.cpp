@@ -1,140 +1,223 @@
 #include "pch.h"
 #include "DenseLayer.h"
+#include "Gemm.h"
 
 namespace cpu {
 
 
-cpu::Vector softmax(const cpu::Vector& v) {
-    cpu::Vector r(v.s);
-    float sum = 0.0f;
-    for (int i = 0; i < v.s; i++) {
-        r[i] = expf(v[i]);
-        sum += r[i];
-    }
-    for (int i = 0; i < v.s; i++) {
-        r[i] = r[i] / sum;
-    }
-    return r;
+DenseLayer::DenseLayer(int in, int out, Activation a, bool io) :
+    isOutput(io), inSize(in), outSize(out),
+    activation(a) {
+}
+
+
+size_t DenseLayer::parameterSize() const {
+    return 2 * gradientSize();
+}
+
+
+size_t DenseLayer::gradientSize() const {
+    return Arena::padded(outSize * inSize) + Arena::padded(outSize);
 }
 
 
-float crossEntropySoftmax(const Vector& output, int label) {
-    float denom = 0.0f;
-    Vector sm(output.s);
-    for (int i = 0; i < output.s; i++) {
-        sm[i] = expf(output[i]);
-        denom += sm[i];
+void DenseLayer::bindParameters(Arena& arena) {
+    MatrixView oldW = W;
+    VectorView oldb = b;
+    MatrixView oldGradW = gradW;
+    VectorView oldGradb = gradb;
+
+    W = MatrixView(arena.allocate(outSize * inSize), outSize, inSize);
+    b = VectorView(arena.allocate(outSize), outSize);
+    gradW = MatrixView(arena.allocate(outSize * inSize), outSize, inSize);
+    gradb = VectorView(arena.allocate(outSize), outSize);
+    if (oldW.data != nullptr) {
+        memcpy(W.data, oldW.data, outSize * inSize * sizeof(float));
+        memcpy(b.data, oldb.data, outSize * sizeof(float));
+        memcpy(gradW.data, oldGradW.data, outSize * inSize * sizeof(float));
+        memcpy(gradb.data, oldGradb.data, outSize * sizeof(float));
     }
-    return -logf(sm[label] / denom);
 }
 
 
-DenseLayer::DenseLayer(int in, int out, Activation a, bool io) : 
-    W(out, in), b(out), 
-    gradW(out, in), gradb(out), 
-    inSize(in), outSize(out), 
-    input(in), output(out),
-    dInput(in), dOutput(out),
-    activation(a), isOutput(io) {
-    std::random_device rd{};
-    std::mt19937 gen{ rd() };
+// Gives the layer its own zeroed gradient accumulators while W and b stay shared
+void DenseLayer::bindGradients(Arena& arena) {
+    gradW = MatrixView(arena.allocate(outSize * inSize), outSize, inSize);
+    gradb = VectorView(arena.allocate(outSize), outSize);
+}
+
+
+// dIn may be empty for the first layer, which then skips the input-gradient product
+void DenseLayer::bindActivations(ConstMatrixView in, MatrixView dIn, MatrixView out, MatrixView dOut) {
+    maxBatchSize = out.h;
+    batchInput = in;
+    batchDInput = dIn;
+    batchOutput = out;
+    batchDOutput = dOut;
+
+    input = ConstVectorView(in.data, inSize);
+    dInput = VectorView(dIn.data, dIn.data == nullptr ? 0 : inSize);
+    output = batchOutput.rowView(0);
+    dOutput = batchDOutput.rowView(0);
+    batchLoss.assign(maxBatchSize, 0.0f);
+    batchPrediction.assign(maxBatchSize, 0);
+    preActivation.assign(needsPreActivation(activation) ? static_cast<size_t>(maxBatchSize) * outSize : 0, 0.0f);
+    setBatchSize(std::min(batchSize, maxBatchSize));
+}
+
+
+// Unit normal weights and biases for sigmoid and linear layers fed by sigmoid or linear
+// ones, as always; anything else would saturate or blow up with those, so it gets He
+// (rectifiers, gelu) or Xavier (the rest, e.g. the logits after relu) scaled weights and
+// zero biases
+void DenseLayer::initParameters(std::mt19937& gen, Activation inputs) {
     std::normal_distribution<float> d{ 0,1 };
+    auto classic = [](Activation a) { return a == Activation::sigmoid || a == Activation::linear; };
+    bool unit = classic(activation) && classic(inputs);
+    bool rectifier = activation == Activation::relu || activation == Activation::leakyRelu || activation == Activation::gelu;
+    float scale = unit ? 1.0f : std::sqrt((rectifier ? 2.0f : 1.0f) / inSize);
 
     for (int i = 0; i < W.h; i++) {
+        float* wi = W.row(i);
         for (int j = 0; j < W.w; j++) {
-            W(i, j) = static_cast<float>(d(gen));;
+            wi[j] = scale * static_cast<float>(d(gen));
         }
-        b[i] = static_cast<float>(d(gen));
+        b[i] = unit ? static_cast<float>(d(gen)) : 0.0f;
     }
     zeroGrad();
 }
 
 
-float gradActivation(float x, Activation a) {
-    if (a == Activation::linear) {
-        return 1.0f;
-    }
-    else {
-        return x * (1 - x);
-    }
+// Copies the biased outputs of the first rows to preActivation and then activates them
+void DenseLayer::activatePreserving(int rows) {
+    size_t n = static_cast<size_t>(rows) * outSize;
+    memcpy(preActivation.data(), batchOutput.data, n * sizeof(float));
+    activate(activation, batchOutput.data, static_cast<int>(n));
 }
 
 
-Vector gradActivation(const Vector& v, Activation a) {
-    Vector r(v.s);
-    for (int i = 0; i < r.s; i++) {
-        r[i] = gradActivation(v[i], a);
+void DenseLayer::forward() {
+    if (needsPreActivation(activation)) {
+        sgemv(false, W.h, W.w, 1.0f, W.data, W.stride, input.data, 0.0f, output.data, b.data, Activation::linear);
+        activatePreserving(1);
+        return;
     }
-    return r;
+    sgemv(false, W.h, W.w, 1.0f, W.data, W.stride, input.data, 0.0f, output.data, b.data, activation);
 }
 
 
-void DenseLayer::forward() {
-    output = W.mul(input) + b;
-    for (int i = 0; i < output.s; i++) {
-        if (activation == Activation::sigmoid) {
-            output[i] = 1.0f / (1.0f + expf(-output[i]));
+void DenseLayer::backward() {
+    gradActivation(activation, preActivation.data(), output.data, dOutput.data, outSize);
+
+    MatrixView g = gradW;
+    const float* x = input.data;
+    const float* d = dOutput.data;
+    for (int i = 0; i < g.h; i++) {
+        float* gi = g.row(i);
+        float di = d[i];
+        for (int j = 0; j < g.w; j++) {
+            gi[j] += di * x[j];
         }
+        gradb.data[i] += di;
+    }
+
+    if (dInput.data != nullptr) {
+        sgemv(true, W.h, W.w, 1.0f, W.data, W.stride, d, 0.0f, dInput.data);
     }
 }
 
 
-void DenseLayer::backward() {
-    Vector gradAct = gradActivation(output, activation);
+void DenseLayer::zeroGrad() {
     for (int i = 0; i < gradW.h; i++) {
-        for (int j = 0; j < gradW.w; j++) {
-            gradW(i, j) += dOutput[i] * input[j] * gradAct[i];
-        }
-        gradb[i] += gradAct[i] * dOutput[i];
+        memset(gradW.row(i), 0, gradW.w * sizeof(float));
     }
+    memset(gradb.data, 0, gradb.s * sizeof(float));
+}
 
-    Vector dInput = Vector(input.s);
-    for (int j = 0; j < dInput.s; j++) {
-        dInput[j] = 0.0f;
-        for (int i = 0; i < dOutput.s; i++) {
-            dInput[j] += W(i, j) * dOutput[i] * gradAct[i];
-        }
-    }
+
+void DenseLayer::initBackProp(int label) {
+    if (!isOutput)
+        return;
+    batchLoss[0] = softmaxCrossEntropy(output.data, outSize, label, dOutput.data, &batchPrediction[0]);
 }
 
 
-void DenseLayer::step(float eps) {
-    for (int i = 0; i < W.h; i++) {
-        for (int j = 0; j < W.w; j++) {
-            W(i, j) -= eps * gradW(i, j);
-        }
-        b[i] -= eps * gradb[i];
+float DenseLayer::loss(int label) {
+    return crossEntropySoftmax(output.data, outSize, label);
+}
+
+
+int DenseLayer::argmax() {
+    return static_cast<int>(std::max_element(output.begin(), output.end()) - output.begin());
+}
+
+
+void DenseLayer::setBatchSize(int n) {
+    if (n > maxBatchSize)
+        throw std::runtime_error("Batch size exceeds bound buffers. Capacity: " + std::to_string(maxBatchSize) + ", requested: " + std::to_string(n));
+    batchSize = n;
+    batchInput.h = n;
+    batchDInput.h = n;
+    batchOutput.h = n;
+    batchDOutput.h = n;
+}
+
+
+void DenseLayer::forwardBatch() {
+    bool preserve = needsPreActivation(activation);
+    Activation fused = preserve ? Activation::linear : activation;
+    if (Wh != nullptr) {
+        sgemmHalf(false, true, batchSize, outSize, inSize, 1.0f, batchInput.data, batchInput.stride, Wh, precision, inSize,
+            0.0f, batchOutput.data, batchOutput.stride, b.data, fused);
+    }
+    else {
+        gemm(false, true, 1.0f, batchInput, W, 0.0f, batchOutput, b.data, fused);
+    }
+    if (preserve) {
+        activatePreserving(batchSize);
     }
 }
 
 
-void DenseLayer::zeroGrad() {
-    for (int i = 0; i < gradW.h; i++) {
-        for (int j = 0; j < gradW.w; j++) {
-            gradW(i, j) = 0.0f;
+void DenseLayer::backwardBatch() {
+    MatrixView delta = batchDOutput;
+    gradActivation(activation, preActivation.data(), batchOutput.data, delta.data, batchSize * outSize);
+    float* gb = gradb.data;
+    for (int r = 0; r < delta.h; r++) {
+        const float* dr = delta.row(r);
+        for (int i = 0; i < outSize; i++) {
+            gb[i] += dr[i];
         }
-        gradb[i] = 0.0f;
+    }
+    gemm(true, false, 1.0f, delta, batchInput, 1.0f, gradW);
+    if (batchDInput.data != nullptr && Wh != nullptr) {
+        sgemmHalf(false, false, delta.h, inSize, outSize, 1.0f, delta.data, delta.stride, Wh, precision, inSize,
+            0.0f, batchDInput.data, batchDInput.stride);
+    }
+    else if (batchDInput.data != nullptr) {
+        gemm(false, false, 1.0f, delta, W, 0.0f, batchDInput);
     }
 }
 
 
-void DenseLayer::initBackProp(int label) {
+// Fills batchLoss and batchPrediction along with the logit gradients
+void DenseLayer::initBackPropBatch(const int* labels) {
     if (!isOutput)
         return;
-    dOutput = softmax(output);
-    for (int i = 0; i < dOutput.s; i++) {
-        dOutput[i] -= i == label ? 1.0f : 0.0f;
+    for (int r = 0; r < batchSize; r++) {
+        batchLoss[r] = softmaxCrossEntropy(batchOutput.row(r), outSize, labels[r], batchDOutput.row(r), &batchPrediction[r]);
     }
 }
 
 
-float DenseLayer::loss(int label) {
-    return crossEntropySoftmax(output, label);
+float DenseLayer::loss(int row, int label) {
+    return crossEntropySoftmax(batchOutput.row(row), outSize, label);
 }
 
 
-int DenseLayer::argmax() {
-    return output.argmax();
+int DenseLayer::argmax(int row) {
+    const float* y = batchOutput.row(row);
+    return static_cast<int>(std::max_element(y, y + outSize) - y);
 }
 
-}
\ No newline at end of file
+}
@@ -1,15 +1,17 @@
 #pragma once
 
+#include <random>
+#include <vector>
 #include "Vector.h"
 #include "Matrix.h"
+#include "Arena.h"
+#include "Activation.h"
+#include "Half.h"
 
 
 namespace cpu {
 
 
-enum Activation { sigmoid, linear };
-
-
 class DenseLayer {
 public:
     bool isOutput = false;
@@ -18,26 +20,60 @@ public:
     int outSize;
     Activation activation;
 
-    Vector input;
-    Vector dInput;
-    Vector output;
-    Vector dOutput;
+    ConstVectorView input;
+    VectorView dInput;
+    VectorView output;
+    VectorView dOutput;
+
+    MatrixView W;
+    VectorView b;
+    MatrixView gradW;
+    VectorView gradb;
+
+    // Optional bf16/fp16 copy of W that the batched products read instead of W; W stays
+    // the fp32 master that the optimizer updates
+    Precision precision = Precision::fp32;
+    const uint16_t* Wh = nullptr;
 
-    Matrix W;
-    Vector b;
-    Matrix gradW;
-    Vector gradb;
+    int batchSize = 1;
+    int maxBatchSize = 0;
+    ConstMatrixView batchInput;
+    MatrixView batchDInput;
+    MatrixView batchOutput;
+    MatrixView batchDOutput;
+
+    std::vector<float> batchLoss;
+    std::vector<int> batchPrediction;
+    // Outputs before the activation, kept only when needsPreActivation(activation)
+    std::vector<float> preActivation;
 
     DenseLayer(int in, int out, Activation a, bool io = false);
 
+    size_t parameterSize() const;
+    size_t gradientSize() const;
+    void bindParameters(Arena& arena);
+    void bindGradients(Arena& arena);
+    void bindActivations(ConstMatrixView in, MatrixView dIn, MatrixView out, MatrixView dOut);
+    // inputs is the activation of the layer feeding this one; the network inputs count as sigmoid
+    void initParameters(std::mt19937& gen, Activation inputs = Activation::sigmoid);
+
     void forward();
     void backward();
-    void step(float learningRate);
     void zeroGrad();
     void initBackProp(int label);
     float loss(int label);
     int argmax();
+
+    void setBatchSize(int n);
+    void forwardBatch();
+    void backwardBatch();
+    void initBackPropBatch(const int* labels);
+    float loss(int row, int label);
+    int argmax(int row);
+
+private:
+    void activatePreserving(int rows);
 };
 
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,82 @@
+#include "pch.h"
+#include "Evaluator.h"
+#include <numeric>
+
+
+namespace nn {
+
+
+const int Evaluator::chunk;
+
+
+Evaluator::Evaluator(int threads, unsigned int seed) : pool(std::max(1, threads)), gen(seed) {
+}
+
+
+void Evaluator::snapshot(const std::vector<cpu::DenseLayer>& layers, const Normalization& norm) {
+    this->norm = norm;
+    weights.assign(layers);
+
+    size_t scratchSize = cpu::Arena::padded(chunk * weights.inputSize()) + 2 * cpu::Arena::padded(chunk * weights.width());
+    if (scratch.empty() || scratch[0].capacity() != scratchSize) {
+        scratch.clear();
+        for (int t = 0; t < pool.size(); t++) {
+            scratch.emplace_back(scratchSize);
+        }
+    }
+}
+
+
+void Evaluator::classify(cpu::Arena& buffers, const ImageSet& images, const int* rows, int n, int* predictions) {
+    buffers.reset();
+    int inSize = weights.inputSize();
+    cpu::MatrixView x(buffers.allocate(chunk * inSize), n, inSize);
+    images.normalize(rows, n, norm, x);
+
+    float* ping = buffers.allocate(chunk * weights.width());
+    float* pong = buffers.allocate(chunk * weights.width());
+
+    cpu::ConstMatrixView in = x;
+    for (auto& layer : weights.layers()) {
+        cpu::MatrixView out(ping, n, layer.W.h);
+        cpu::gemm(false, true, 1.0f, in, layer.W, 0.0f, out, layer.b, layer.activation);
+        in = out;
+        std::swap(ping, pong);
+    }
+
+    for (int i = 0; i < n; i++) {
+        const float* y = in.row(i);
+        predictions[i] = static_cast<int>(std::max_element(y, y + in.w) - y);
+    }
+}
+
+
+float Evaluator::evaluate(const ImageSet& images, const std::vector<int>& labels, int n, ConfusionMatrix& confusion) {
+    int size = static_cast<int>(labels.size());
+    n = std::min(n, size);
+    order.resize(size);
+    std::iota(order.begin(), order.end(), 0);
+    if (n < size) {
+        for (int i = 0; i < n; i++) {
+            std::uniform_int_distribution<int> d(i, size - 1);
+            std::swap(order[i], order[d(gen)]);
+        }
+        std::sort(order.begin(), order.begin() + n);
+    }
+
+    confusion.reset();
+    int chunks = (n + chunk - 1) / chunk;
+    pool.run(chunks, [&](int c) {
+        int begin = c * chunk;
+        int count = std::min(chunk, n - begin);
+        int predictions[chunk];
+        classify(scratch[c % pool.size()], images, &order[begin], count, predictions);
+        for (int i = 0; i < count; i++) {
+            confusion.add(predictions[i], labels[order[begin + i]]);
+        }
+    });
+    return confusion.accuracy();
+}
+
+
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <random>
+#include <vector>
+#include "Arena.h"
+#include "Dataset.h"
+#include "DenseLayer.h"
+#include "Matrix.h"
+#include "Metrics.h"
+#include "PackedWeights.h"
+#include "ThreadPool.h"
+
+
+namespace nn {
+
+
+// Inference-only copy of a network. snapshot() copies the weights and the input
+// normalization, after which evaluate() classifies test rows in batches on its own pool
+// without touching the training layers, so it can run while training continues.
+class Evaluator {
+public:
+    static const int chunk = 256;
+
+    Evaluator(int threads, unsigned int seed);
+
+    int threads() const { return pool.size(); }
+
+    void snapshot(const std::vector<cpu::DenseLayer>& layers, const Normalization& norm);
+
+    // Classifies n rows of images drawn without replacement (all of them when n covers
+    // the set), fills confusion and returns the accuracy
+    float evaluate(const ImageSet& images, const std::vector<int>& labels, int n, ConfusionMatrix& confusion);
+
+private:
+    cpu::ThreadPool pool;
+    PackedWeights weights;
+    Normalization norm;
+    std::vector<cpu::Arena> scratch;
+    std::vector<int> order;
+    std::mt19937 gen;
+
+    void classify(cpu::Arena& buffers, const ImageSet& images, const int* rows, int n, int* predictions);
+};
+
+
+}
@@ -0,0 +1,383 @@
+#include "pch.h"
+#include "FastMath.h"
+#include "Simd.h"
+#include <atomic>
+#include <cfloat>
+
+
+namespace cpu {
+namespace fastmath {
+
+
+// exp(x) = 2^n * e^r with n = round(x / ln 2) and |r| <= ln 2 / 2; ln 2 is split in two
+// so that x - n ln 2 stays exact
+static const float LOG2E = 1.44269504088896341f;
+static const float LN2_HI = 0.693359375f;
+static const float LN2_LO = -2.12194440e-4f;
+static const float EXP_MAX = 88.7228394f;
+static const float EXP_MIN = -103.972084f;
+static const float EXP_P[] = { 1.9875691500e-4f, 1.3981999507e-3f, 8.3334519073e-3f, 4.1665795894e-2f, 1.6666665459e-1f, 5.0000001201e-1f };
+
+// log(x) = e ln 2 + log(m) with m in [sqrt(1/2), sqrt(2))
+static const float SQRT_HALF = 0.707106781186547524f;
+static const float LOG_P[] = { 7.0376836292e-2f, -1.1514610310e-1f, 1.1676998740e-1f, -1.2420140846e-1f, 1.4249322787e-1f,
+    -1.6668057665e-1f, 2.0000714765e-1f, -2.4999993993e-1f, 3.3333331174e-1f };
+
+// tanh(x) is an odd polynomial below TANH_SMALL and 1 - 2 / (exp(2x) + 1) above
+static const float TANH_SMALL = 0.625f;
+static const float TANH_P[] = { -5.70498872745e-3f, 2.06390887954e-2f, -5.37397155531e-2f, 1.33314422036e-1f, -3.33332819422e-1f };
+
+
+typedef void (*MathKernel)(const float* x, float* y, int n);
+
+
+// Relaxed is enough: the switch orders nothing else, and a kernel that starts just before
+// a change may still use the previous setting
+static std::atomic<bool>& current() {
+    static std::atomic<bool> on{ false };
+    return on;
+}
+
+
+bool enabled() {
+    return current().load(std::memory_order_relaxed);
+}
+
+
+void setEnabled(bool on) {
+    current().store(on, std::memory_order_relaxed);
+}
+
+
+static float fromBits(uint32_t b) {
+    float f;
+    memcpy(&f, &b, sizeof(f));
+    return f;
+}
+
+
+static uint32_t toBits(float f) {
+    uint32_t b;
+    memcpy(&b, &f, sizeof(b));
+    return b;
+}
+
+
+// 2^e for e in [-126, 127]
+static float pow2(int e) {
+    return fromBits(static_cast<uint32_t>(e + 127) << 23);
+}
+
+
+static float expScalar(float x) {
+    if (x != x)
+        return x;
+    if (x > EXP_MAX)
+        return INFINITY;
+    if (x < EXP_MIN)
+        return 0.0f;
+    float n = std::nearbyint(x * LOG2E);
+    float r = x - n * LN2_HI - n * LN2_LO;
+    float p = EXP_P[0];
+    for (int i = 1; i < 6; i++) {
+        p = p * r + EXP_P[i];
+    }
+    p = p * r * r + r + 1.0f;
+    // Two factors keep 2^n representable from the subnormal range up to n = 128
+    int e = static_cast<int>(n);
+    return p * pow2(e >> 1) * pow2(e - (e >> 1));
+}
+
+
+static float logScalar(float x) {
+    if (x != x || x < 0.0f)
+        return NAN;
+    if (x == 0.0f)
+        return -INFINITY;
+    if (x == INFINITY)
+        return x;
+    int e = 0;
+    if (x < FLT_MIN) {
+        x *= 8388608.0f;
+        e = -23;
+    }
+    uint32_t b = toBits(x);
+    e += static_cast<int>(b >> 23) - 126;
+    float m = fromBits((b & 0x007fffff) | 0x3f000000);
+    if (m < SQRT_HALF) {
+        e -= 1;
+        m = m + m - 1.0f;
+    }
+    else {
+        m = m - 1.0f;
+    }
+    float z = m * m;
+    float p = LOG_P[0];
+    for (int i = 1; i < 9; i++) {
+        p = p * m + LOG_P[i];
+    }
+    float fe = static_cast<float>(e);
+    float y = p * m * z + fe * LN2_LO - 0.5f * z;
+    return m + y + fe * LN2_HI;
+}
+
+
+static float sigmoidScalar(float x) {
+    return 1.0f / (1.0f + expScalar(-x));
+}
+
+
+static float tanhScalar(float x) {
+    float a = std::fabs(x);
+    if (a < TANH_SMALL) {
+        float z = x * x;
+        float p = TANH_P[0];
+        for (int i = 1; i < 5; i++) {
+            p = p * z + TANH_P[i];
+        }
+        return p * z * x + x;
+    }
+    float t = 1.0f - 2.0f / (expScalar(2.0f * a) + 1.0f);
+    return std::copysign(t, x);
+}
+
+
+template <float (*F)(float)>
+static void applyScalar(const float* x, float* y, int n) {
+    for (int i = 0; i < n; i++) {
+        y[i] = F(x[i]);
+    }
+}
+
+
+#if defined(GENN_X86)
+GENN_TARGET_AVX2 static __m256 exp8(__m256 x) {
+    __m256 xc = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(EXP_MIN)), _mm256_set1_ps(EXP_MAX));
+    __m256 n = _mm256_round_ps(_mm256_mul_ps(xc, _mm256_set1_ps(LOG2E)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256 r = _mm256_fnmadd_ps(n, _mm256_set1_ps(LN2_HI), xc);
+    r = _mm256_fnmadd_ps(n, _mm256_set1_ps(LN2_LO), r);
+    __m256 p = _mm256_set1_ps(EXP_P[0]);
+    for (int i = 1; i < 6; i++) {
+        p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(EXP_P[i]));
+    }
+    p = _mm256_add_ps(_mm256_fmadd_ps(p, _mm256_mul_ps(r, r), r), _mm256_set1_ps(1.0f));
+
+    __m256i e = _mm256_cvtps_epi32(n);
+    __m256i e1 = _mm256_srai_epi32(e, 1);
+    __m256i e2 = _mm256_sub_epi32(e, e1);
+    __m256i bias = _mm256_set1_epi32(127);
+    __m256 s1 = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(e1, bias), 23));
+    __m256 s2 = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(e2, bias), 23));
+    __m256 y = _mm256_mul_ps(_mm256_mul_ps(p, s1), s2);
+
+    y = _mm256_blendv_ps(y, _mm256_set1_ps(INFINITY), _mm256_cmp_ps(x, _mm256_set1_ps(EXP_MAX), _CMP_GT_OQ));
+    y = _mm256_blendv_ps(y, _mm256_setzero_ps(), _mm256_cmp_ps(x, _mm256_set1_ps(EXP_MIN), _CMP_LT_OQ));
+    return _mm256_blendv_ps(y, x, _mm256_cmp_ps(x, x, _CMP_UNORD_Q));
+}
+
+
+GENN_TARGET_AVX2 static __m256 log8(__m256 x) {
+    __m256 zero = _mm256_setzero_ps();
+    __m256 subnormal = _mm256_and_ps(_mm256_cmp_ps(x, _mm256_set1_ps(FLT_MIN), _CMP_LT_OQ), _mm256_cmp_ps(x, zero, _CMP_GT_OQ));
+    __m256 v = _mm256_blendv_ps(x, _mm256_mul_ps(x, _mm256_set1_ps(8388608.0f)), subnormal);
+    __m256i b = _mm256_castps_si256(v);
+    __m256 e = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(b, 23), _mm256_set1_epi32(126)));
+    e = _mm256_sub_ps(e, _mm256_and_ps(subnormal, _mm256_set1_ps(23.0f)));
+    __m256 m = _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(b, _mm256_set1_epi32(0x007fffff)), _mm256_set1_epi32(0x3f000000)));
+    __m256 small = _mm256_cmp_ps(m, _mm256_set1_ps(SQRT_HALF), _CMP_LT_OQ);
+    e = _mm256_sub_ps(e, _mm256_and_ps(small, _mm256_set1_ps(1.0f)));
+    m = _mm256_sub_ps(_mm256_add_ps(m, _mm256_and_ps(small, m)), _mm256_set1_ps(1.0f));
+
+    __m256 z = _mm256_mul_ps(m, m);
+    __m256 p = _mm256_set1_ps(LOG_P[0]);
+    for (int i = 1; i < 9; i++) {
+        p = _mm256_fmadd_ps(p, m, _mm256_set1_ps(LOG_P[i]));
+    }
+    __m256 y = _mm256_mul_ps(_mm256_mul_ps(p, m), z);
+    y = _mm256_fmadd_ps(e, _mm256_set1_ps(LN2_LO), y);
+    y = _mm256_fnmadd_ps(_mm256_set1_ps(0.5f), z, y);
+    y = _mm256_fmadd_ps(e, _mm256_set1_ps(LN2_HI), _mm256_add_ps(m, y));
+
+    y = _mm256_blendv_ps(y, x, _mm256_cmp_ps(x, _mm256_set1_ps(INFINITY), _CMP_EQ_OQ));
+    y = _mm256_blendv_ps(y, _mm256_set1_ps(-INFINITY), _mm256_cmp_ps(x, zero, _CMP_EQ_OQ));
+    return _mm256_blendv_ps(y, _mm256_set1_ps(NAN), _mm256_cmp_ps(x, zero, _CMP_NGE_UQ));
+}
+
+
+GENN_TARGET_AVX2 static __m256 sigmoid8(__m256 x) {
+    __m256 one = _mm256_set1_ps(1.0f);
+    return _mm256_div_ps(one, _mm256_add_ps(one, exp8(_mm256_sub_ps(_mm256_setzero_ps(), x))));
+}
+
+
+GENN_TARGET_AVX2 static __m256 tanh8(__m256 x) {
+    __m256 sign = _mm256_set1_ps(-0.0f);
+    __m256 a = _mm256_andnot_ps(sign, x);
+    __m256 z = _mm256_mul_ps(x, x);
+    __m256 p = _mm256_set1_ps(TANH_P[0]);
+    for (int i = 1; i < 5; i++) {
+        p = _mm256_fmadd_ps(p, z, _mm256_set1_ps(TANH_P[i]));
+    }
+    __m256 small = _mm256_fmadd_ps(_mm256_mul_ps(p, z), x, x);
+
+    __m256 one = _mm256_set1_ps(1.0f);
+    __m256 t = exp8(_mm256_add_ps(a, a));
+    __m256 large = _mm256_sub_ps(one, _mm256_div_ps(_mm256_set1_ps(2.0f), _mm256_add_ps(t, one)));
+    large = _mm256_or_ps(large, _mm256_and_ps(sign, x));
+    return _mm256_blendv_ps(large, small, _mm256_cmp_ps(a, _mm256_set1_ps(TANH_SMALL), _CMP_LT_OQ));
+}
+
+
+GENN_TARGET_AVX512 static __m512 exp16(__m512 x) {
+    __m512 xc = _mm512_min_ps(_mm512_max_ps(x, _mm512_set1_ps(EXP_MIN)), _mm512_set1_ps(EXP_MAX));
+    __m512 n = _mm512_roundscale_ps(_mm512_mul_ps(xc, _mm512_set1_ps(LOG2E)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m512 r = _mm512_fnmadd_ps(n, _mm512_set1_ps(LN2_HI), xc);
+    r = _mm512_fnmadd_ps(n, _mm512_set1_ps(LN2_LO), r);
+    __m512 p = _mm512_set1_ps(EXP_P[0]);
+    for (int i = 1; i < 6; i++) {
+        p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(EXP_P[i]));
+    }
+    p = _mm512_add_ps(_mm512_fmadd_ps(p, _mm512_mul_ps(r, r), r), _mm512_set1_ps(1.0f));
+
+    __m512i e = _mm512_cvtps_epi32(n);
+    __m512i e1 = _mm512_srai_epi32(e, 1);
+    __m512i e2 = _mm512_sub_epi32(e, e1);
+    __m512i bias = _mm512_set1_epi32(127);
+    __m512 s1 = _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_add_epi32(e1, bias), 23));
+    __m512 s2 = _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_add_epi32(e2, bias), 23));
+    __m512 y = _mm512_mul_ps(_mm512_mul_ps(p, s1), s2);
+
+    y = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(x, _mm512_set1_ps(EXP_MAX), _CMP_GT_OQ), y, _mm512_set1_ps(INFINITY));
+    y = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(x, _mm512_set1_ps(EXP_MIN), _CMP_LT_OQ), y, _mm512_setzero_ps());
+    return _mm512_mask_blend_ps(_mm512_cmp_ps_mask(x, x, _CMP_UNORD_Q), y, x);
+}
+
+
+GENN_TARGET_AVX512 static __m512 log16(__m512 x) {
+    __m512 zero = _mm512_setzero_ps();
+    __mmask16 subnormal = _mm512_cmp_ps_mask(x, _mm512_set1_ps(FLT_MIN), _CMP_LT_OQ) & _mm512_cmp_ps_mask(x, zero, _CMP_GT_OQ);
+    __m512 v = _mm512_mask_mul_ps(x, subnormal, x, _mm512_set1_ps(8388608.0f));
+    __m512i b = _mm512_castps_si512(v);
+    __m512 e = _mm512_cvtepi32_ps(_mm512_sub_epi32(_mm512_srli_epi32(b, 23), _mm512_set1_epi32(126)));
+    e = _mm512_mask_sub_ps(e, subnormal, e, _mm512_set1_ps(23.0f));
+    __m512 m = _mm512_castsi512_ps(_mm512_or_si512(_mm512_and_si512(b, _mm512_set1_epi32(0x007fffff)), _mm512_set1_epi32(0x3f000000)));
+    __mmask16 small = _mm512_cmp_ps_mask(m, _mm512_set1_ps(SQRT_HALF), _CMP_LT_OQ);
+    e = _mm512_mask_sub_ps(e, small, e, _mm512_set1_ps(1.0f));
+    m = _mm512_sub_ps(_mm512_mask_add_ps(m, small, m, m), _mm512_set1_ps(1.0f));
+
+    __m512 z = _mm512_mul_ps(m, m);
+    __m512 p = _mm512_set1_ps(LOG_P[0]);
+    for (int i = 1; i < 9; i++) {
+        p = _mm512_fmadd_ps(p, m, _mm512_set1_ps(LOG_P[i]));
+    }
+    __m512 y = _mm512_mul_ps(_mm512_mul_ps(p, m), z);
+    y = _mm512_fmadd_ps(e, _mm512_set1_ps(LN2_LO), y);
+    y = _mm512_fnmadd_ps(_mm512_set1_ps(0.5f), z, y);
+    y = _mm512_fmadd_ps(e, _mm512_set1_ps(LN2_HI), _mm512_add_ps(m, y));
+
+    y = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(x, _mm512_set1_ps(INFINITY), _CMP_EQ_OQ), y, x);
+    y = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(x, zero, _CMP_EQ_OQ), y, _mm512_set1_ps(-INFINITY));
+    return _mm512_mask_blend_ps(_mm512_cmp_ps_mask(x, zero, _CMP_NGE_UQ), y, _mm512_set1_ps(NAN));
+}
+
+
+GENN_TARGET_AVX512 static __m512 sigmoid16(__m512 x) {
+    __m512 one = _mm512_set1_ps(1.0f);
+    return _mm512_div_ps(one, _mm512_add_ps(one, exp16(_mm512_sub_ps(_mm512_setzero_ps(), x))));
+}
+
+
+GENN_TARGET_AVX512 static __m512 tanh16(__m512 x) {
+    __m512i sign = _mm512_set1_epi32(static_cast<int>(0x80000000u));
+    __m512i bits = _mm512_castps_si512(x);
+    __m512 a = _mm512_castsi512_ps(_mm512_andnot_si512(sign, bits));
+    __m512 z = _mm512_mul_ps(x, x);
+    __m512 p = _mm512_set1_ps(TANH_P[0]);
+    for (int i = 1; i < 5; i++) {
+        p = _mm512_fmadd_ps(p, z, _mm512_set1_ps(TANH_P[i]));
+    }
+    __m512 small = _mm512_fmadd_ps(_mm512_mul_ps(p, z), x, x);
+
+    __m512 one = _mm512_set1_ps(1.0f);
+    __m512 t = exp16(_mm512_add_ps(a, a));
+    __m512 large = _mm512_sub_ps(one, _mm512_div_ps(_mm512_set1_ps(2.0f), _mm512_add_ps(t, one)));
+    large = _mm512_castsi512_ps(_mm512_or_si512(_mm512_castps_si512(large), _mm512_and_si512(sign, bits)));
+    return _mm512_mask_blend_ps(_mm512_cmp_ps_mask(a, _mm512_set1_ps(TANH_SMALL), _CMP_LT_OQ), large, small);
+}
+
+
+template <__m256 (*F)(__m256), float (*Tail)(float)>
+GENN_TARGET_AVX2 static void applyAvx2(const float* x, float* y, int n) {
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(y + i, F(_mm256_loadu_ps(x + i)));
+    }
+    applyScalar<Tail>(x + i, y + i, n - i);
+}
+
+
+template <__m512 (*F)(__m512)>
+GENN_TARGET_AVX512 static void applyAvx512(const float* x, float* y, int n) {
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        _mm512_storeu_ps(y + i, F(_mm512_loadu_ps(x + i)));
+    }
+    if (i < n) {
+        __mmask16 tail = static_cast<__mmask16>((1u << (n - i)) - 1);
+        _mm512_mask_storeu_ps(y + i, tail, F(_mm512_maskz_loadu_ps(tail, x + i)));
+    }
+}
+
+
+template <float (*F)(float), __m256 (*F8)(__m256), __m512 (*F16)(__m512)>
+static MathKernel select() {
+    switch (simd::level()) {
+    case simd::avx512:
+        return applyAvx512<F16>;
+    case simd::avx2:
+        return applyAvx2<F8, F>;
+    default:
+        return applyScalar<F>;
+    }
+}
+#endif // GENN_X86
+
+
+void exp(const float* x, float* y, int n) {
+#if defined(GENN_X86)
+    select<expScalar, exp8, exp16>()(x, y, n);
+#else
+    applyScalar<expScalar>(x, y, n);
+#endif // GENN_X86
+}
+
+
+void log(const float* x, float* y, int n) {
+#if defined(GENN_X86)
+    select<logScalar, log8, log16>()(x, y, n);
+#else
+    applyScalar<logScalar>(x, y, n);
+#endif // GENN_X86
+}
+
+
+void sigmoid(const float* x, float* y, int n) {
+#if defined(GENN_X86)
+    select<sigmoidScalar, sigmoid8, sigmoid16>()(x, y, n);
+#else
+    applyScalar<sigmoidScalar>(x, y, n);
+#endif // GENN_X86
+}
+
+
+void tanh(const float* x, float* y, int n) {
+#if defined(GENN_X86)
+    select<tanhScalar, tanh8, tanh16>()(x, y, n);
+#else
+    applyScalar<tanhScalar>(x, y, n);
+#endif // GENN_X86
+}
+
+
+}
+}
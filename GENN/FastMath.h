@@ -0,0 +1,29 @@
+#pragma once
+
+
+namespace cpu {
+namespace fastmath {
+
+
+// Whether the activations and the softmax losses use these kernels instead of calling
+// libm per element; off by default, and setEnabled may be called from any thread
+bool enabled();
+void setEnabled(bool on);
+
+// Vectorized Cephes-style polynomial approximations over n floats; y may alias x. Error
+// bounds against libm in units in the last place of the result, as checked by
+// genn-bench --check-math on every 64th float (largest error seen at any SIMD level):
+//   exp      2 ulp (1.0) on [-87.3, 88.7]; gradual underflow down to -104, then 0; +inf above
+//   log      2 ulp (0.8) on positive floats, subnormals included; -inf at 0, NaN below
+//   sigmoid  3 ulp (2.4) where the result is at least 1e-30, i.e. above -69
+//   tanh     2 ulp (1.3)
+// NaN inputs give NaN. The SIMD levels use FMA and the scalar fallback does not, so the
+// levels can differ in the last bit.
+void exp(const float* x, float* y, int n);
+void log(const float* x, float* y, int n);
+void sigmoid(const float* x, float* y, int n);
+void tanh(const float* x, float* y, int n);
+
+
+}
+}
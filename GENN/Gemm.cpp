@@ -0,0 +1,516 @@
+#include "pch.h"
+#include "Gemm.h"
+#include "Simd.h"
+
+
+namespace cpu {
+
+
+// Cache blocking: a KC x NC panel of B stays in L2/L3, an MC x KC block of A in L2,
+// and the micro-kernel streams one MR x KC sliver of A against one KC x NR sliver of B.
+static const int KC = 256;
+static const int MC = 96;
+static const int NC = 2048;
+static const int MAX_TILE = 8 * 32;
+
+
+typedef void (*MicroKernel)(int kc, const float* a, const float* b, float* c, int ldc, float beta);
+typedef void (*GemvKernel)(int M, int N, float alpha, const float* A, int lda, const float* x, float* y);
+
+struct Tile {
+    int mr;
+    int nr;
+    MicroKernel kernel;
+};
+
+
+static void kernelScalar(int kc, const float* a, const float* b, float* c, int ldc, float beta) {
+    float acc[4][8] = {};
+    for (int k = 0; k < kc; k++) {
+        for (int i = 0; i < 4; i++) {
+            float ai = a[i];
+            for (int j = 0; j < 8; j++) {
+                acc[i][j] += ai * b[j];
+            }
+        }
+        a += 4;
+        b += 8;
+    }
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 8; j++) {
+            c[i * ldc + j] = beta == 0.0f ? acc[i][j] : acc[i][j] + beta * c[i * ldc + j];
+        }
+    }
+}
+
+
+static void gemvScalar(int M, int N, float alpha, const float* A, int lda, const float* x, float* y) {
+    for (int i = 0; i < M; i++) {
+        const float* a = A + i * lda;
+        float s = 0.0f;
+        for (int j = 0; j < N; j++) {
+            s += a[j] * x[j];
+        }
+        y[i] += alpha * s;
+    }
+}
+
+
+static void gemvTScalar(int M, int N, float alpha, const float* A, int lda, const float* x, float* y) {
+    for (int i = 0; i < M; i++) {
+        const float* a = A + i * lda;
+        float xi = alpha * x[i];
+        for (int j = 0; j < N; j++) {
+            y[j] += xi * a[j];
+        }
+    }
+}
+
+
+#if defined(GENN_X86)
+GENN_TARGET_AVX2 static void kernelAvx2(int kc, const float* a, const float* b, float* c, int ldc, float beta) {
+    __m256 acc[6][2];
+    for (int i = 0; i < 6; i++) {
+        acc[i][0] = _mm256_setzero_ps();
+        acc[i][1] = _mm256_setzero_ps();
+    }
+    for (int k = 0; k < kc; k++) {
+        __m256 b0 = _mm256_loadu_ps(b);
+        __m256 b1 = _mm256_loadu_ps(b + 8);
+        for (int i = 0; i < 6; i++) {
+            __m256 ai = _mm256_broadcast_ss(a + i);
+            acc[i][0] = _mm256_fmadd_ps(ai, b0, acc[i][0]);
+            acc[i][1] = _mm256_fmadd_ps(ai, b1, acc[i][1]);
+        }
+        a += 6;
+        b += 16;
+    }
+    __m256 vb = _mm256_set1_ps(beta);
+    for (int i = 0; i < 6; i++) {
+        float* ci = c + i * ldc;
+        if (beta != 0.0f) {
+            acc[i][0] = _mm256_fmadd_ps(vb, _mm256_loadu_ps(ci), acc[i][0]);
+            acc[i][1] = _mm256_fmadd_ps(vb, _mm256_loadu_ps(ci + 8), acc[i][1]);
+        }
+        _mm256_storeu_ps(ci, acc[i][0]);
+        _mm256_storeu_ps(ci + 8, acc[i][1]);
+    }
+}
+
+
+GENN_TARGET_AVX2 static inline float hsum(__m256 v) {
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_movehdup_ps(s));
+    return _mm_cvtss_f32(s);
+}
+
+
+GENN_TARGET_AVX2 static void gemvAvx2(int M, int N, float alpha, const float* A, int lda, const float* x, float* y) {
+    int i = 0;
+    for (; i + 4 <= M; i += 4) {
+        const float* a0 = A + i * lda;
+        const float* a1 = a0 + lda;
+        const float* a2 = a1 + lda;
+        const float* a3 = a2 + lda;
+        __m256 s0 = _mm256_setzero_ps();
+        __m256 s1 = _mm256_setzero_ps();
+        __m256 s2 = _mm256_setzero_ps();
+        __m256 s3 = _mm256_setzero_ps();
+        int j = 0;
+        for (; j + 8 <= N; j += 8) {
+            __m256 xv = _mm256_loadu_ps(x + j);
+            s0 = _mm256_fmadd_ps(_mm256_loadu_ps(a0 + j), xv, s0);
+            s1 = _mm256_fmadd_ps(_mm256_loadu_ps(a1 + j), xv, s1);
+            s2 = _mm256_fmadd_ps(_mm256_loadu_ps(a2 + j), xv, s2);
+            s3 = _mm256_fmadd_ps(_mm256_loadu_ps(a3 + j), xv, s3);
+        }
+        float r0 = hsum(s0), r1 = hsum(s1), r2 = hsum(s2), r3 = hsum(s3);
+        for (; j < N; j++) {
+            r0 += a0[j] * x[j];
+            r1 += a1[j] * x[j];
+            r2 += a2[j] * x[j];
+            r3 += a3[j] * x[j];
+        }
+        y[i] += alpha * r0;
+        y[i + 1] += alpha * r1;
+        y[i + 2] += alpha * r2;
+        y[i + 3] += alpha * r3;
+    }
+    for (; i < M; i++) {
+        const float* a = A + i * lda;
+        __m256 s = _mm256_setzero_ps();
+        int j = 0;
+        for (; j + 8 <= N; j += 8) {
+            s = _mm256_fmadd_ps(_mm256_loadu_ps(a + j), _mm256_loadu_ps(x + j), s);
+        }
+        float r = hsum(s);
+        for (; j < N; j++) {
+            r += a[j] * x[j];
+        }
+        y[i] += alpha * r;
+    }
+}
+
+
+GENN_TARGET_AVX2 static void gemvTAvx2(int M, int N, float alpha, const float* A, int lda, const float* x, float* y) {
+    int i = 0;
+    for (; i + 4 <= M; i += 4) {
+        const float* a0 = A + i * lda;
+        const float* a1 = a0 + lda;
+        const float* a2 = a1 + lda;
+        const float* a3 = a2 + lda;
+        float s0 = alpha * x[i], s1 = alpha * x[i + 1], s2 = alpha * x[i + 2], s3 = alpha * x[i + 3];
+        __m256 x0 = _mm256_set1_ps(s0), x1 = _mm256_set1_ps(s1), x2 = _mm256_set1_ps(s2), x3 = _mm256_set1_ps(s3);
+        int j = 0;
+        for (; j + 8 <= N; j += 8) {
+            __m256 acc = _mm256_loadu_ps(y + j);
+            acc = _mm256_fmadd_ps(x0, _mm256_loadu_ps(a0 + j), acc);
+            acc = _mm256_fmadd_ps(x1, _mm256_loadu_ps(a1 + j), acc);
+            acc = _mm256_fmadd_ps(x2, _mm256_loadu_ps(a2 + j), acc);
+            acc = _mm256_fmadd_ps(x3, _mm256_loadu_ps(a3 + j), acc);
+            _mm256_storeu_ps(y + j, acc);
+        }
+        for (; j < N; j++) {
+            y[j] += s0 * a0[j] + s1 * a1[j] + s2 * a2[j] + s3 * a3[j];
+        }
+    }
+    for (; i < M; i++) {
+        const float* a = A + i * lda;
+        float s = alpha * x[i];
+        __m256 xv = _mm256_set1_ps(s);
+        int j = 0;
+        for (; j + 8 <= N; j += 8) {
+            _mm256_storeu_ps(y + j, _mm256_fmadd_ps(xv, _mm256_loadu_ps(a + j), _mm256_loadu_ps(y + j)));
+        }
+        for (; j < N; j++) {
+            y[j] += s * a[j];
+        }
+    }
+}
+
+
+GENN_TARGET_AVX512 static void kernelAvx512(int kc, const float* a, const float* b, float* c, int ldc, float beta) {
+    __m512 acc[8][2];
+    for (int i = 0; i < 8; i++) {
+        acc[i][0] = _mm512_setzero_ps();
+        acc[i][1] = _mm512_setzero_ps();
+    }
+    for (int k = 0; k < kc; k++) {
+        __m512 b0 = _mm512_loadu_ps(b);
+        __m512 b1 = _mm512_loadu_ps(b + 16);
+        for (int i = 0; i < 8; i++) {
+            __m512 ai = _mm512_set1_ps(a[i]);
+            acc[i][0] = _mm512_fmadd_ps(ai, b0, acc[i][0]);
+            acc[i][1] = _mm512_fmadd_ps(ai, b1, acc[i][1]);
+        }
+        a += 8;
+        b += 32;
+    }
+    __m512 vb = _mm512_set1_ps(beta);
+    for (int i = 0; i < 8; i++) {
+        float* ci = c + i * ldc;
+        if (beta != 0.0f) {
+            acc[i][0] = _mm512_fmadd_ps(vb, _mm512_loadu_ps(ci), acc[i][0]);
+            acc[i][1] = _mm512_fmadd_ps(vb, _mm512_loadu_ps(ci + 16), acc[i][1]);
+        }
+        _mm512_storeu_ps(ci, acc[i][0]);
+        _mm512_storeu_ps(ci + 16, acc[i][1]);
+    }
+}
+
+
+GENN_TARGET_AVX512 static void gemvAvx512(int M, int N, float alpha, const float* A, int lda, const float* x, float* y) {
+    int i = 0;
+    for (; i + 4 <= M; i += 4) {
+        const float* a0 = A + i * lda;
+        const float* a1 = a0 + lda;
+        const float* a2 = a1 + lda;
+        const float* a3 = a2 + lda;
+        __m512 s0 = _mm512_setzero_ps();
+        __m512 s1 = _mm512_setzero_ps();
+        __m512 s2 = _mm512_setzero_ps();
+        __m512 s3 = _mm512_setzero_ps();
+        int j = 0;
+        for (; j + 16 <= N; j += 16) {
+            __m512 xv = _mm512_loadu_ps(x + j);
+            s0 = _mm512_fmadd_ps(_mm512_loadu_ps(a0 + j), xv, s0);
+            s1 = _mm512_fmadd_ps(_mm512_loadu_ps(a1 + j), xv, s1);
+            s2 = _mm512_fmadd_ps(_mm512_loadu_ps(a2 + j), xv, s2);
+            s3 = _mm512_fmadd_ps(_mm512_loadu_ps(a3 + j), xv, s3);
+        }
+        if (j < N) {
+            __mmask16 m = static_cast<__mmask16>((1u << (N - j)) - 1);
+            __m512 xv = _mm512_maskz_loadu_ps(m, x + j);
+            s0 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(m, a0 + j), xv, s0);
+            s1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(m, a1 + j), xv, s1);
+            s2 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(m, a2 + j), xv, s2);
+            s3 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(m, a3 + j), xv, s3);
+        }
+        y[i] += alpha * _mm512_reduce_add_ps(s0);
+        y[i + 1] += alpha * _mm512_reduce_add_ps(s1);
+        y[i + 2] += alpha * _mm512_reduce_add_ps(s2);
+        y[i + 3] += alpha * _mm512_reduce_add_ps(s3);
+    }
+    for (; i < M; i++) {
+        const float* a = A + i * lda;
+        __m512 s = _mm512_setzero_ps();
+        int j = 0;
+        for (; j + 16 <= N; j += 16) {
+            s = _mm512_fmadd_ps(_mm512_loadu_ps(a + j), _mm512_loadu_ps(x + j), s);
+        }
+        if (j < N) {
+            __mmask16 m = static_cast<__mmask16>((1u << (N - j)) - 1);
+            s = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(m, a + j), _mm512_maskz_loadu_ps(m, x + j), s);
+        }
+        y[i] += alpha * _mm512_reduce_add_ps(s);
+    }
+}
+
+
+GENN_TARGET_AVX512 static void gemvTAvx512(int M, int N, float alpha, const float* A, int lda, const float* x, float* y) {
+    int i = 0;
+    for (; i + 4 <= M; i += 4) {
+        const float* a0 = A + i * lda;
+        const float* a1 = a0 + lda;
+        const float* a2 = a1 + lda;
+        const float* a3 = a2 + lda;
+        __m512 x0 = _mm512_set1_ps(alpha * x[i]);
+        __m512 x1 = _mm512_set1_ps(alpha * x[i + 1]);
+        __m512 x2 = _mm512_set1_ps(alpha * x[i + 2]);
+        __m512 x3 = _mm512_set1_ps(alpha * x[i + 3]);
+        int j = 0;
+        for (; j < N; j += 16) {
+            __mmask16 m = N - j >= 16 ? static_cast<__mmask16>(0xffff) : static_cast<__mmask16>((1u << (N - j)) - 1);
+            __m512 acc = _mm512_maskz_loadu_ps(m, y + j);
+            acc = _mm512_fmadd_ps(x0, _mm512_maskz_loadu_ps(m, a0 + j), acc);
+            acc = _mm512_fmadd_ps(x1, _mm512_maskz_loadu_ps(m, a1 + j), acc);
+            acc = _mm512_fmadd_ps(x2, _mm512_maskz_loadu_ps(m, a2 + j), acc);
+            acc = _mm512_fmadd_ps(x3, _mm512_maskz_loadu_ps(m, a3 + j), acc);
+            _mm512_mask_storeu_ps(y + j, m, acc);
+        }
+    }
+    for (; i < M; i++) {
+        const float* a = A + i * lda;
+        __m512 xv = _mm512_set1_ps(alpha * x[i]);
+        for (int j = 0; j < N; j += 16) {
+            __mmask16 m = N - j >= 16 ? static_cast<__mmask16>(0xffff) : static_cast<__mmask16>((1u << (N - j)) - 1);
+            __m512 acc = _mm512_fmadd_ps(xv, _mm512_maskz_loadu_ps(m, a + j), _mm512_maskz_loadu_ps(m, y + j));
+            _mm512_mask_storeu_ps(y + j, m, acc);
+        }
+    }
+}
+#endif
+
+
+static Tile selectTile() {
+#if defined(GENN_X86)
+    switch (simd::level()) {
+    case simd::avx512:
+        return Tile{ 8, 32, kernelAvx512 };
+    case simd::avx2:
+        return Tile{ 6, 16, kernelAvx2 };
+    default:
+        break;
+    }
+#endif
+    return Tile{ 4, 8, kernelScalar };
+}
+
+
+static GemvKernel selectGemv(bool trans) {
+#if defined(GENN_X86)
+    switch (simd::level()) {
+    case simd::avx512:
+        return trans ? gemvTAvx512 : gemvAvx512;
+    case simd::avx2:
+        return trans ? gemvTAvx2 : gemvAvx2;
+    default:
+        break;
+    }
+#endif
+    return trans ? gemvTScalar : gemvScalar;
+}
+
+
+// Copies op(A)[i0:i0+mc, k0:k0+kc] into mr-row slivers, k-major inside a sliver, zero padded
+static void packA(bool trans, const float* A, int lda, int i0, int k0, int mc, int kc, int mr, float alpha, float* dst) {
+    for (int ir = 0; ir < mc; ir += mr) {
+        int m = std::min(mr, mc - ir);
+        for (int k = 0; k < kc; k++) {
+            for (int i = 0; i < m; i++) {
+                int row = i0 + ir + i;
+                int col = k0 + k;
+                dst[i] = alpha * (trans ? A[col * lda + row] : A[row * lda + col]);
+            }
+            for (int i = m; i < mr; i++) {
+                dst[i] = 0.0f;
+            }
+            dst += mr;
+        }
+    }
+}
+
+
+// Half-precision B is widened to fp32 while packing, so the micro-kernels and the
+// accumulation stay fp32 whatever the storage format
+static void load(const float* src, float* dst, int n, Precision) {
+    memcpy(dst, src, n * sizeof(float));
+}
+
+
+static void load(const uint16_t* src, float* dst, int n, Precision p) {
+    fromHalf(p, src, dst, n);
+}
+
+
+// Copies op(B)[k0:k0+kc, j0:j0+nc] into nr-column slivers, k-major inside a sliver, zero padded
+template <typename T>
+static void packB(bool trans, const T* B, int ldb, Precision p, int k0, int j0, int kc, int nc, int nr, float* dst) {
+    float row[KC];
+    for (int jr = 0; jr < nc; jr += nr) {
+        int n = std::min(nr, nc - jr);
+        if (trans) {
+            for (int j = 0; j < n; j++) {
+                load(B + (j0 + jr + j) * ldb + k0, row, kc, p);
+                for (int k = 0; k < kc; k++) {
+                    dst[k * nr + j] = row[k];
+                }
+            }
+            for (int k = 0; k < kc; k++) {
+                for (int j = n; j < nr; j++) {
+                    dst[k * nr + j] = 0.0f;
+                }
+            }
+        }
+        else {
+            for (int k = 0; k < kc; k++) {
+                load(B + (k0 + k) * ldb + j0 + jr, dst + k * nr, n, p);
+                for (int j = n; j < nr; j++) {
+                    dst[k * nr + j] = 0.0f;
+                }
+            }
+        }
+        dst += kc * nr;
+    }
+}
+
+
+static void scale(int M, int N, float beta, float* C, int ldc) {
+    for (int i = 0; i < M; i++) {
+        float* c = C + i * ldc;
+        for (int j = 0; j < N; j++) {
+            c[j] = beta == 0.0f ? 0.0f : beta * c[j];
+        }
+    }
+}
+
+
+template <typename T>
+static void gemm(bool transA, bool transB, int M, int N, int K,
+    float alpha, const float* A, int lda, const T* B, int ldb, Precision p,
+    float beta, float* C, int ldc,
+    const float* bias, Activation act) {
+    if (M <= 0 || N <= 0)
+        return;
+    bool epilogue = bias != nullptr || act != Activation::linear;
+    if (K <= 0 || alpha == 0.0f) {
+        scale(M, N, beta, C, ldc);
+        for (int i = 0; epilogue && i < M; i++) {
+            activate(act, C + i * ldc, bias, N);
+        }
+        return;
+    }
+
+    Tile t = selectTile();
+    int mcMax = (std::min(MC, M) + t.mr - 1) / t.mr * t.mr;
+    int ncMax = (std::min(NC, N) + t.nr - 1) / t.nr * t.nr;
+    int kcMax = std::min(KC, K);
+    thread_local std::vector<float> packedA;
+    thread_local std::vector<float> packedB;
+    if ((int)packedA.size() < mcMax * kcMax)
+        packedA.resize(mcMax * kcMax);
+    if ((int)packedB.size() < ncMax * kcMax)
+        packedB.resize(ncMax * kcMax);
+    float tile[MAX_TILE];
+
+    for (int jc = 0; jc < N; jc += NC) {
+        int nc = std::min(NC, N - jc);
+        for (int pc = 0; pc < K; pc += KC) {
+            int kc = std::min(KC, K - pc);
+            float b = pc == 0 ? beta : 1.0f;
+            bool last = epilogue && pc + kc == K;
+            packB(transB, B, ldb, p, pc, jc, kc, nc, t.nr, packedB.data());
+
+            for (int ic = 0; ic < M; ic += MC) {
+                int mc = std::min(MC, M - ic);
+                packA(transA, A, lda, ic, pc, mc, kc, t.mr, alpha, packedA.data());
+
+                for (int jr = 0; jr < nc; jr += t.nr) {
+                    int n = std::min(t.nr, nc - jr);
+                    for (int ir = 0; ir < mc; ir += t.mr) {
+                        int m = std::min(t.mr, mc - ir);
+                        const float* pa = packedA.data() + ir * kc;
+                        const float* pb = packedB.data() + jr * kc;
+                        float* c = C + (ic + ir) * ldc + jc + jr;
+                        if (m == t.mr && n == t.nr) {
+                            t.kernel(kc, pa, pb, c, ldc, b);
+                        }
+                        else {
+                            t.kernel(kc, pa, pb, tile, t.nr, 0.0f);
+                            for (int i = 0; i < m; i++) {
+                                for (int j = 0; j < n; j++) {
+                                    float v = tile[i * t.nr + j];
+                                    c[i * ldc + j] = b == 0.0f ? v : v + b * c[i * ldc + j];
+                                }
+                            }
+                        }
+                        for (int i = 0; last && i < m; i++) {
+                            activate(act, c + i * ldc, bias == nullptr ? nullptr : bias + jc + jr, n);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+void sgemm(bool transA, bool transB, int M, int N, int K,
+    float alpha, const float* A, int lda, const float* B, int ldb,
+    float beta, float* C, int ldc,
+    const float* bias, Activation act) {
+    if (M == 1 && N > 0 && !transA) {
+        sgemv(!transB, transB ? N : K, transB ? K : N, alpha, B, ldb, A, beta, C, bias, act);
+        return;
+    }
+    gemm(transA, transB, M, N, K, alpha, A, lda, B, ldb, Precision::fp32, beta, C, ldc, bias, act);
+}
+
+
+void sgemmHalf(bool transA, bool transB, int M, int N, int K,
+    float alpha, const float* A, int lda, const uint16_t* B, Precision p, int ldb,
+    float beta, float* C, int ldc,
+    const float* bias, Activation act) {
+    gemm(transA, transB, M, N, K, alpha, A, lda, B, ldb, p, beta, C, ldc, bias, act);
+}
+
+
+void sgemv(bool transA, int M, int N,
+    float alpha, const float* A, int lda, const float* x,
+    float beta, float* y,
+    const float* bias, Activation act) {
+    int ny = transA ? N : M;
+    if (beta != 1.0f) {
+        scale(1, ny, beta, y, ny);
+    }
+    if (M > 0 && N > 0 && alpha != 0.0f) {
+        selectGemv(transA)(M, N, alpha, A, lda, x, y);
+    }
+    if (bias != nullptr || act != Activation::linear) {
+        activate(act, y, bias, ny);
+    }
+}
+
+
+}
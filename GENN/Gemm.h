@@ -0,0 +1,31 @@
+#pragma once
+
+#include "Activation.h"
+#include "Half.h"
+
+
+namespace cpu {
+
+
+// Row-major C (M x N) = act(alpha * op(A) * op(B) + beta * C + bias), op(A) is M x K, op(B) is K x N,
+// bias has N entries; the epilogue runs on each tile while it is still in cache
+void sgemm(bool transA, bool transB, int M, int N, int K,
+    float alpha, const float* A, int lda, const float* B, int ldb,
+    float beta, float* C, int ldc,
+    const float* bias = nullptr, Activation act = Activation::linear);
+
+// sgemm with B stored as bf16 or fp16; B is widened to fp32 as it is packed and the
+// products accumulate in fp32
+void sgemmHalf(bool transA, bool transB, int M, int N, int K,
+    float alpha, const float* A, int lda, const uint16_t* B, Precision p, int ldb,
+    float beta, float* C, int ldc,
+    const float* bias = nullptr, Activation act = Activation::linear);
+
+// Row-major A is M x N; y = act(alpha * A * x + beta * y + bias), or with A^T when transA
+void sgemv(bool transA, int M, int N,
+    float alpha, const float* A, int lda, const float* x,
+    float beta, float* y,
+    const float* bias = nullptr, Activation act = Activation::linear);
+
+
+}
@@ -0,0 +1,195 @@
+#include "pch.h"
+#include "Half.h"
+#include "Simd.h"
+
+
+namespace cpu {
+
+
+typedef void (*ToHalfKernel)(const float* src, uint16_t* dst, size_t n);
+typedef void (*FromHalfKernel)(const uint16_t* src, float* dst, size_t n);
+
+
+static void toBf16Scalar(const float* src, uint16_t* dst, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        dst[i] = floatToBf16(src[i]);
+    }
+}
+
+
+static void toFp16Scalar(const float* src, uint16_t* dst, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        dst[i] = floatToFp16(src[i]);
+    }
+}
+
+
+static void fromBf16Scalar(const uint16_t* src, float* dst, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        dst[i] = bf16ToFloat(src[i]);
+    }
+}
+
+
+static void fromFp16Scalar(const uint16_t* src, float* dst, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        dst[i] = fp16ToFloat(src[i]);
+    }
+}
+
+
+#if defined(GENN_X86)
+// Emulated round-to-nearest-even bf16: add 0x7fff plus the lowest kept bit, truncate,
+// and substitute quiet NaNs afterwards
+GENN_TARGET_AVX2 static void toBf16Avx2(const float* src, uint16_t* dst, size_t n) {
+    __m256i bias = _mm256_set1_epi32(0x7fff);
+    __m256i one = _mm256_set1_epi32(1);
+    __m256i abs = _mm256_set1_epi32(0x7fffffff);
+    __m256i inf = _mm256_set1_epi32(0x7f800000);
+    __m256i quiet = _mm256_set1_epi32(0x40);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i x = _mm256_castps_si256(_mm256_loadu_ps(src + i));
+        __m256i high = _mm256_srli_epi32(x, 16);
+        __m256i r = _mm256_srli_epi32(_mm256_add_epi32(x, _mm256_add_epi32(bias, _mm256_and_si256(high, one))), 16);
+        __m256i nan = _mm256_cmpgt_epi32(_mm256_and_si256(x, abs), inf);
+        r = _mm256_blendv_epi8(r, _mm256_or_si256(high, quiet), nan);
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(r, r), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm256_castsi256_si128(packed));
+    }
+    toBf16Scalar(src + i, dst + i, n - i);
+}
+
+
+GENN_TARGET_AVX2 static void toFp16Avx2(const float* src, uint16_t* dst, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), h);
+    }
+    toFp16Scalar(src + i, dst + i, n - i);
+}
+
+
+GENN_TARGET_AVX2 static void fromBf16Avx2(const uint16_t* src, float* dst, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i x = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)));
+        _mm256_storeu_ps(dst + i, _mm256_castsi256_ps(_mm256_slli_epi32(x, 16)));
+    }
+    fromBf16Scalar(src + i, dst + i, n - i);
+}
+
+
+GENN_TARGET_AVX2 static void fromFp16Avx2(const uint16_t* src, float* dst, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i))));
+    }
+    fromFp16Scalar(src + i, dst + i, n - i);
+}
+
+
+GENN_TARGET_AVX512 static void toBf16Avx512(const float* src, uint16_t* dst, size_t n) {
+    __m512i bias = _mm512_set1_epi32(0x7fff);
+    __m512i one = _mm512_set1_epi32(1);
+    __m512i abs = _mm512_set1_epi32(0x7fffffff);
+    __m512i inf = _mm512_set1_epi32(0x7f800000);
+    __m512i quiet = _mm512_set1_epi32(0x40);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512i x = _mm512_castps_si512(_mm512_loadu_ps(src + i));
+        __m512i high = _mm512_srli_epi32(x, 16);
+        __m512i r = _mm512_srli_epi32(_mm512_add_epi32(x, _mm512_add_epi32(bias, _mm512_and_si512(high, one))), 16);
+        __mmask16 nan = _mm512_cmpgt_epi32_mask(_mm512_and_si512(x, abs), inf);
+        r = _mm512_mask_blend_epi32(nan, r, _mm512_or_si512(high, quiet));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm512_cvtepi32_epi16(r));
+    }
+    toBf16Scalar(src + i, dst + i, n - i);
+}
+
+
+GENN_TARGET_AVX512 static void toFp16Avx512(const float* src, uint16_t* dst, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i h = _mm512_cvtps_ph(_mm512_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), h);
+    }
+    toFp16Scalar(src + i, dst + i, n - i);
+}
+
+
+GENN_TARGET_AVX512 static void fromBf16Avx512(const uint16_t* src, float* dst, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512i x = _mm512_cvtepu16_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i)));
+        _mm512_storeu_ps(dst + i, _mm512_castsi512_ps(_mm512_slli_epi32(x, 16)));
+    }
+    fromBf16Scalar(src + i, dst + i, n - i);
+}
+
+
+GENN_TARGET_AVX512 static void fromFp16Avx512(const uint16_t* src, float* dst, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        _mm512_storeu_ps(dst + i, _mm512_cvtph_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i))));
+    }
+    fromFp16Scalar(src + i, dst + i, n - i);
+}
+
+
+// Native vcvtneps2bf16; it flushes subnormal inputs to zero, unlike the emulation
+GENN_TARGET_BF16 static void toBf16Native(const float* src, uint16_t* dst, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256bh h = _mm512_cvtneps_pbh(_mm512_loadu_ps(src + i));
+        memcpy(dst + i, &h, sizeof(h));
+    }
+    toBf16Scalar(src + i, dst + i, n - i);
+}
+#endif
+
+
+static ToHalfKernel selectToHalf(Precision p) {
+#if defined(GENN_X86)
+    if (p == Precision::bf16 && simd::bf16())
+        return toBf16Native;
+    switch (simd::level()) {
+    case simd::avx512:
+        return p == Precision::bf16 ? toBf16Avx512 : toFp16Avx512;
+    case simd::avx2:
+        return p == Precision::bf16 ? toBf16Avx2 : toFp16Avx2;
+    default:
+        break;
+    }
+#endif
+    return p == Precision::bf16 ? toBf16Scalar : toFp16Scalar;
+}
+
+
+static FromHalfKernel selectFromHalf(Precision p) {
+#if defined(GENN_X86)
+    switch (simd::level()) {
+    case simd::avx512:
+        return p == Precision::bf16 ? fromBf16Avx512 : fromFp16Avx512;
+    case simd::avx2:
+        return p == Precision::bf16 ? fromBf16Avx2 : fromFp16Avx2;
+    default:
+        break;
+    }
+#endif
+    return p == Precision::bf16 ? fromBf16Scalar : fromFp16Scalar;
+}
+
+
+void toHalf(Precision p, const float* src, uint16_t* dst, size_t n) {
+    selectToHalf(p)(src, dst, n);
+}
+
+
+void fromHalf(Precision p, const uint16_t* src, float* dst, size_t n) {
+    selectFromHalf(p)(src, dst, n);
+}
+
+
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+
+namespace cpu {
+
+
+// Storage format of weights in mixed-precision training; arithmetic is always fp32
+enum Precision { fp32, bf16, fp16 };
+
+
+inline float bf16ToFloat(uint16_t h) {
+    uint32_t bits = static_cast<uint32_t>(h) << 16;
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+
+// Round to nearest even; NaNs stay (quiet) NaNs
+inline uint16_t floatToBf16(float f) {
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    if ((bits & 0x7fffffff) > 0x7f800000)
+        return static_cast<uint16_t>((bits >> 16) | 0x40);
+    bits += 0x7fff + ((bits >> 16) & 1);
+    return static_cast<uint16_t>(bits >> 16);
+}
+
+
+inline float fp16ToFloat(uint16_t h) {
+    uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+    uint32_t exponent = (h >> 10) & 0x1f;
+    uint32_t mantissa = h & 0x3ff;
+    uint32_t bits;
+    if (exponent == 0) {
+        float f = static_cast<float>(mantissa) * (1.0f / 16777216.0f);
+        memcpy(&bits, &f, sizeof(bits));
+        bits |= sign;
+    }
+    else if (exponent == 31) {
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    }
+    else {
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    }
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+
+// Round to nearest even; overflow goes to infinity, small values to subnormals and NaNs
+// keep their top payload bits as with F16C
+inline uint16_t floatToFp16(float f) {
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+    uint32_t magnitude = bits & 0x7fffffff;
+    if (magnitude > 0x7f800000)
+        return sign | 0x7e00 | static_cast<uint16_t>((magnitude >> 13) & 0x3ff);
+    if (magnitude >= 0x477ff000)
+        return sign | 0x7c00;
+    if (magnitude < 0x38800000)
+        return sign | static_cast<uint16_t>(std::nearbyint(std::fabs(f) * 16777216.0f));
+    return sign | static_cast<uint16_t>((magnitude - 0x38000000 + 0xfff + ((magnitude >> 13) & 1)) >> 13);
+}
+
+
+// Bulk conversions between fp32 and the 16-bit formats; p must not be fp32
+void toHalf(Precision p, const float* src, uint16_t* dst, size_t n);
+void fromHalf(Precision p, const uint16_t* src, float* dst, size_t n);
+
+
+}
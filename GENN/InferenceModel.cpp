@@ -0,0 +1,92 @@
+#include "pch.h"
+#include "InferenceModel.h"
+#include "Gemm.h"
+
+
+namespace nn {
+
+
+static bool matchesMnistNetwork(const std::vector<cpu::DenseLayer>& layers) {
+    return layers.size() == 3 &&
+        layers[0].inSize == 784 && layers[0].outSize == 64 && layers[0].activation == cpu::Activation::sigmoid &&
+        layers[1].inSize == 64 && layers[1].outSize == 64 && layers[1].activation == cpu::Activation::sigmoid &&
+        layers[2].inSize == 64 && layers[2].outSize == 10 && layers[2].activation == cpu::Activation::linear;
+}
+
+
+// Layers whose parameter views point into the checkpoint mapping; they are only read
+// while the constructor packs them
+static std::vector<cpu::DenseLayer> mappedLayers(const Checkpoint& checkpoint) {
+    std::vector<cpu::DenseLayer> layers;
+    for (int i = 0; i < (int)checkpoint.layers().size(); i++) {
+        const CheckpointLayer& l = checkpoint.layers()[i];
+        cpu::DenseLayer layer(l.in, l.out, l.activation, l.isOutput);
+        layer.W = cpu::MatrixView(const_cast<float*>(checkpoint.tensor(weightName(i), static_cast<size_t>(l.out) * l.in)), l.out, l.in);
+        layer.b = cpu::VectorView(const_cast<float*>(checkpoint.tensor(biasName(i), l.out)), l.out);
+        layers.push_back(layer);
+    }
+    return layers;
+}
+
+
+InferenceModel::InferenceModel(const Checkpoint& checkpoint) :
+    InferenceModel(mappedLayers(checkpoint), checkpoint.state().normalization) {
+}
+
+
+InferenceModel::InferenceModel(const std::vector<cpu::DenseLayer>& layers, const Normalization& norm) : norm(norm) {
+    if (layers.empty())
+        throw std::runtime_error("Cannot build an inference model without layers");
+    weights.assign(layers);
+
+    if (matchesMnistNetwork(layers)) {
+        specialized.reset(new cpu::MnistNetwork());
+        specialized->load(layers);
+    }
+}
+
+
+float* InferenceModel::scratch(size_t floats) const {
+    thread_local cpu::Arena buffers;
+    if (buffers.capacity() < floats)
+        buffers = cpu::Arena(floats);
+    buffers.reset();
+    return buffers.allocate(floats);
+}
+
+
+int InferenceModel::classify(const uint8_t* pixels) const {
+    if (specialized) {
+        alignas(64) float x[cpu::MnistNetwork::inputs];
+        normalizePixels(pixels, x, cpu::MnistNetwork::inputs, norm);
+        return specialized->classify(x);
+    }
+
+    int inSize = inputSize();
+    size_t padded = cpu::Arena::padded(std::max(inSize, weights.width()));
+    float* x = scratch(3 * padded);
+    float* ping = x + padded;
+    float* pong = ping + padded;
+    normalizePixels(pixels, x, inSize, norm);
+
+    const float* in = x;
+    for (auto& layer : weights.layers()) {
+        cpu::sgemv(false, layer.W.h, layer.W.w, 1.0f, layer.W.data, layer.W.stride, in, 0.0f, ping, layer.b, layer.activation);
+        in = ping;
+        std::swap(ping, pong);
+    }
+    return static_cast<int>(std::max_element(in, in + classes()) - in);
+}
+
+
+// gemm repacks its B operand on every call, which at these layer widths costs more than
+// it saves, so batches run through the single-sample kernels with the weights kept hot
+void InferenceModel::classifyBatch(const uint8_t* pixels, int n, int* predictions) const {
+    size_t stride = inputSize();
+    for (int i = 0; i < n; i++) {
+        predictions[i] = classify(pixels + i * stride);
+    }
+}
+
+
+}
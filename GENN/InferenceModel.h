@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "Arena.h"
+#include "Checkpoint.h"
+#include "Dataset.h"
+#include "DenseLayer.h"
+#include "Matrix.h"
+#include "PackedWeights.h"
+#include "StaticNetwork.h"
+
+
+namespace nn {
+
+
+// Frozen, read-only copy of a trained network for serving. The weights and the input
+// normalization are packed into one aligned block at construction and never change, so
+// any number of threads may classify through the same model concurrently. Calls do not
+// allocate: temporaries live on the stack or in a per-thread scratch block that is sized
+// on a thread's first call and reused afterwards.
+class InferenceModel {
+public:
+    InferenceModel(const std::vector<cpu::DenseLayer>& layers, const Normalization& norm);
+    // Serves a saved model without constructing a Network or training
+    explicit InferenceModel(const Checkpoint& checkpoint);
+
+    int inputSize() const { return weights.inputSize(); }
+    int classes() const { return weights.classes(); }
+
+    // pixels holds inputSize() raw uint8 values
+    int classify(const uint8_t* pixels) const;
+    // pixels holds n consecutive images; writes n predicted classes
+    void classifyBatch(const uint8_t* pixels, int n, int* predictions) const;
+
+private:
+    PackedWeights weights;
+    Normalization norm;
+
+    // Register-blocked kernels for the production topology, used when the layers match it
+    std::unique_ptr<cpu::MnistNetwork> specialized;
+
+    float* scratch(size_t floats) const;
+};
+
+
+}
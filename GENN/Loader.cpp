@@ -0,0 +1,184 @@
+#include "pch.h"
+#include "Loader.h"
+#include <numeric>
+
+
+namespace nn {
+
+
+BatchLoader::BatchLoader(std::shared_ptr<SampleSource> source, const Normalization& norm,
+    int batchSize, long long position, unsigned int seed, const LoaderOptions& options) :
+    source(std::move(source)), norm(norm), batchSize(batchSize), start(position), seed(seed), options(options) {
+    if (this->source->size() == 0)
+        throw std::runtime_error("BatchLoader needs a non-empty dataset");
+    this->options.chunk = std::max(1, options.chunk);
+    this->options.shuffleWindow = std::max(options.shuffleWindow, this->options.chunk);
+
+    int pixels = this->source->pixels();
+    slots.resize(std::max(2, options.depth));
+    for (auto& slot : slots) {
+        slot.buffer = cpu::Arena(static_cast<size_t>(batchSize) * pixels);
+        slot.batch.x = cpu::MatrixView(slot.buffer.allocate(static_cast<size_t>(batchSize) * pixels), batchSize, pixels);
+        slot.batch.labels.resize(batchSize);
+        slot.batch.samples.resize(batchSize);
+    }
+    worker = std::thread(&BatchLoader::produce, this);
+}
+
+
+BatchLoader::~BatchLoader() {
+    {
+        std::lock_guard<std::mutex> guard(m);
+        stopping = true;
+    }
+    released.notify_all();
+    worker.join();
+}
+
+
+const Batch& BatchLoader::next() {
+    std::unique_lock<std::mutex> lock(m);
+    if (holding) {
+        ++consumed;
+        holding = false;
+        released.notify_one();
+    }
+    ready.wait(lock, [this] { return produced > consumed || error; });
+    if (produced == consumed)
+        std::rethrow_exception(error);
+    holding = true;
+    return slots[consumed % slots.size()].batch;
+}
+
+
+void BatchLoader::produce() {
+    try {
+        int size = source->size();
+        long long position = start;
+        std::vector<uint8_t> pixels(source->pixels());
+        while (true) {
+            int p = static_cast<int>(position % size);
+            beginEpoch(position / size, p);
+            while (p < size) {
+                {
+                    std::unique_lock<std::mutex> lock(m);
+                    released.wait(lock, [this] { return stopping || produced - consumed < (long long)slots.size(); });
+                    if (stopping)
+                        return;
+                }
+
+                Batch& batch = slots[produced % slots.size()].batch;
+                int count = std::min(batchSize, size - p);
+                batch.position = position;
+                batch.count = count;
+                batch.x.h = count;
+                std::seed_seq s{ seed, static_cast<unsigned int>(position), static_cast<unsigned int>(position >> 32) };
+                std::mt19937 gen(s);
+                for (int i = 0; i < count; i++) {
+                    batch.samples[i] = draw(pixels.data(), &batch.labels[i]);
+                    augment(pixels.data(), batch.x.row(i), gen);
+                }
+                p += count;
+                position += count;
+
+                std::lock_guard<std::mutex> guard(m);
+                ++produced;
+                ready.notify_one();
+            }
+        }
+    }
+    catch (...) {
+        std::lock_guard<std::mutex> guard(m);
+        error = std::current_exception();
+        ready.notify_one();
+    }
+}
+
+
+void BatchLoader::beginEpoch(long long epoch, int p) {
+    int size = source->size();
+    std::seed_seq s{ seed, static_cast<unsigned int>(epoch), static_cast<unsigned int>(epoch >> 32) };
+    epochGen.seed(s);
+    order.clear();
+    cursor = p;
+
+    if (options.shuffle && !source->resident()) {
+        int chunks = (size + options.chunk - 1) / options.chunk;
+        order.resize(chunks);
+        std::iota(order.begin(), order.end(), 0);
+        std::shuffle(order.begin(), order.end(), epochGen);
+        nextChunk = p / options.chunk;
+        filled = 0;
+        window.resize(static_cast<size_t>(options.shuffleWindow) * source->pixels());
+        windowLabels.resize(options.shuffleWindow);
+        windowSamples.resize(options.shuffleWindow);
+    }
+    else if (options.shuffle) {
+        order.resize(size);
+        std::iota(order.begin(), order.end(), 0);
+        std::shuffle(order.begin(), order.end(), epochGen);
+    }
+}
+
+
+// Returns the dataset row of the next sample of the epoch and copies it out
+int BatchLoader::draw(uint8_t* pixels, int* label) {
+    int n = source->pixels();
+    if (!options.shuffle || source->resident()) {
+        int sample = order.empty() ? cursor : order[cursor];
+        ++cursor;
+        source->read(sample, 1, pixels, label);
+        return sample;
+    }
+
+    int size = source->size();
+    while (filled + options.chunk <= options.shuffleWindow && nextChunk < (int)order.size()) {
+        int first = order[nextChunk++] * options.chunk;
+        int count = std::min(options.chunk, size - first);
+        source->read(first, count, &window[static_cast<size_t>(filled) * n], &windowLabels[filled]);
+        for (int k = 0; k < count; k++) {
+            windowSamples[filled + k] = first + k;
+        }
+        filled += count;
+    }
+    if (filled == 0)
+        throw std::logic_error("Shuffle window drained before the end of the epoch");
+
+    int j = std::uniform_int_distribution<int>(0, filled - 1)(epochGen);
+    int sample = windowSamples[j];
+    memcpy(pixels, &window[static_cast<size_t>(j) * n], n);
+    *label = windowLabels[j];
+    --filled;
+    if (j != filled) {
+        memcpy(&window[static_cast<size_t>(j) * n], &window[static_cast<size_t>(filled) * n], n);
+        windowLabels[j] = windowLabels[filled];
+        windowSamples[j] = windowSamples[filled];
+    }
+    return sample;
+}
+
+
+// Shifted images are translated with zero fill before normalization
+void BatchLoader::augment(const uint8_t* src, float* dst, std::mt19937& gen) {
+    int n = source->pixels();
+    if (options.maxShift <= 0) {
+        normalizePixels(src, dst, n, norm);
+        return;
+    }
+
+    std::uniform_int_distribution<int> shift(-options.maxShift, options.maxShift);
+    int h = source->rows();
+    int w = source->cols();
+    int dy = shift(gen);
+    int dx = shift(gen);
+    int c0 = std::max(0, dx);
+    int c1 = std::min(w, w + dx);
+    shifted.assign(n, 0);
+    for (int r = std::max(0, dy); r < std::min(h, h + dy) && c0 < c1; r++) {
+        memcpy(&shifted[r * w + c0], src + (r - dy) * w + (c0 - dx), c1 - c0);
+    }
+    normalizePixels(shifted.data(), dst, n, norm);
+}
+
+
+}
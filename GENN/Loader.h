@@ -0,0 +1,94 @@
+#pragma once
+
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+#include "Arena.h"
+#include "Dataset.h"
+#include "Matrix.h"
+#include "Source.h"
+
+
+namespace nn {
+
+
+struct LoaderOptions {
+    bool shuffle = true;
+    int maxShift = 0;           // random translation of up to this many pixels; 0 disables it
+    int depth = 3;              // batches prepared ahead of the trainer
+    int shuffleWindow = 65536;  // samples held for shuffling streamed sources
+    int chunk = 4096;           // samples per read from streamed sources
+};
+
+
+struct Batch {
+    long long position = 0;     // stream position of the first row
+    int count = 0;
+    cpu::MatrixView x;
+    std::vector<int> labels;
+    std::vector<int> samples;   // dataset rows the batch was drawn from
+};
+
+
+// Background producer of normalized training batches. Resident sources are ordered by a
+// full shuffle seeded from (seed, epoch). Streamed sources are read a chunk at a time in
+// a shuffled chunk order and drawn at random from a bounded window; resuming them
+// restarts the window at the chunk holding the start position. Either way the sequence
+// depends only on the seed and start position, not on timing. A batch returned by
+// next() stays valid until the following call.
+class BatchLoader {
+public:
+    BatchLoader(std::shared_ptr<SampleSource> source, const Normalization& norm,
+        int batchSize, long long position, unsigned int seed, const LoaderOptions& options);
+    BatchLoader(const BatchLoader&) = delete;
+    BatchLoader& operator= (const BatchLoader&) = delete;
+    ~BatchLoader();
+
+    const Batch& next();
+
+private:
+    struct Slot {
+        cpu::Arena buffer;
+        Batch batch;
+    };
+
+    std::shared_ptr<SampleSource> source;
+    Normalization norm;
+    int batchSize;
+    long long start;
+    unsigned int seed;
+    LoaderOptions options;
+
+    std::vector<Slot> slots;
+    std::mutex m;
+    std::condition_variable ready;
+    std::condition_variable released;
+    long long produced = 0;
+    long long consumed = 0;
+    bool holding = false;
+    bool stopping = false;
+    std::exception_ptr error;
+    std::thread worker;
+
+    // Per-epoch sampling state, touched only by the producer
+    std::vector<int> order;
+    int cursor = 0;
+    std::mt19937 epochGen;
+    std::vector<uint8_t> window;
+    std::vector<int> windowLabels;
+    std::vector<int> windowSamples;
+    int filled = 0;
+    int nextChunk = 0;
+    std::vector<uint8_t> shifted;
+
+    void produce();
+    void beginEpoch(long long epoch, int p);
+    int draw(uint8_t* pixels, int* label);
+    void augment(const uint8_t* src, float* dst, std::mt19937& gen);
+};
+
+
+}
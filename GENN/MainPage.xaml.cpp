@@ -25,7 +25,7 @@ using namespace Windows::System::Threading;
 // The Blank Page item template is documented at https://go.microsoft.com/fwlink/?LinkId=402352&clcid=0x409
 
 MainPage::MainPage() : labels(1) {
-    images = { cpu::Matrix(1, 1) };
+    images = nn::ImageSet(std::vector<cpu::Matrix>{ cpu::Matrix(1, 1) });
     dashboard = cv::Mat(400, 400, CV_8UC3, cv::Scalar(0));
     InitializeComponent();
 }
@@ -37,7 +37,7 @@ void MainPage::updateLayout(ThreadPoolTimer^ timer) {
         ref new Windows::UI::Core::DispatchedHandler([this] { 
             int p = network.getPosition() % (int)images.size();
             trainProgress->Value = p;
-            epochText->Text = "" + (network.epoch + 1);
+            epochText->Text = "" + (network.getEpoch() + 1);
             lossText->Text = "" + network.meanLoss();
             trPrecText->Text = "" + network.trainPrecision();
             testPrecText->Text = "" + network.testPrecision();
@@ -50,11 +50,14 @@ void GENN::MainPage::updateImages(ThreadPoolTimer^ timer) {
     trainProgress->Dispatcher->RunAsync(
         Windows::UI::Core::CoreDispatcherPriority::Normal,
         ref new Windows::UI::Core::DispatchedHandler([this] {
-            int p = network.getPosition();
-            if (p > 64) {
-                std::vector<cpu::Matrix> currentImages(images.begin() + p - 16, images.begin() + p);
-                std::vector<int> predictions = network.getPredictions(16);
-                dashboard = drawDashboard(currentImages, predictions, network.getLoss(), network.confusionMatrix);
+            if (network.getPosition() >= 16) {
+                std::vector<cpu::Matrix> currentImages;
+                std::vector<int> predictions;
+                for (auto& prediction : network.getPredictions(16)) {
+                    currentImages.push_back(images.toMatrix(prediction.sample));
+                    predictions.push_back(prediction.predicted);
+                }
+                dashboard = drawDashboard(currentImages, predictions, network.getLoss(), network.testConfusion()->toMatrix());
                 updateDashboard();
             }
         })
@@ -64,10 +67,10 @@ void GENN::MainPage::updateImages(ThreadPoolTimer^ timer) {
 
 void GENN::MainPage::loadMNIST(Platform::Object^ sender, Windows::UI::Xaml::RoutedEventArgs^ e) {
     std::thread t([this]() {
-        read_Mnist("train-images.idx3-ubyte", images);
-        read_Mnist_Label("train-labels.idx1-ubyte", labels);
-        read_Mnist("t10k-images.idx3-ubyte", testImages);
-        read_Mnist_Label("t10k-labels.idx1-ubyte", testLabels);
+        images = nn::ImageSet(std::make_shared<const IdxFile>("train-images.idx3-ubyte"));
+        labels = readIdxLabels("train-labels.idx1-ubyte");
+        testImages = nn::ImageSet(std::make_shared<const IdxFile>("t10k-images.idx3-ubyte"));
+        testLabels = readIdxLabels("t10k-labels.idx1-ubyte");
         testOrder.resize(testImages.size());
         for (int i = 0; i < testOrder.size(); i++) {
             testOrder[i] = i;
@@ -175,7 +178,7 @@ void GENN::MainPage::testNN(Platform::Object^ sender, Windows::UI::Xaml::RoutedE
     float prec = network.test(1000);
     testPrecText->Text = "" + prec;
 
-    cv::Mat confMatrix = plotConfusionMatrix(network.confusionMatrix);
+    cv::Mat confMatrix = plotConfusionMatrix(network.testConfusion()->toMatrix());
     cv::Mat roi = dashboard(cv::Rect(cv::Point(200, 40), cv::Size(200, 200)));
     confMatrix.convertTo(confMatrix, CV_8UC3);
     cv::cvtColor(confMatrix, confMatrix, CV_GRAY2BGRA);
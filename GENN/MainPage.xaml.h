@@ -28,11 +28,11 @@ namespace GENN
 
 	private:
 
-		std::vector<cpu::Matrix> images;
+		nn::ImageSet images;
 		std::vector<int> labels;
 
 		std::vector<int> testOrder;
-		std::vector<cpu::Matrix> testImages;
+		nn::ImageSet testImages;
 		std::vector<int> testLabels;
 
 		nn::Network network;
@@ -1,32 +1,32 @@
 #include "pch.h"
 #include "Matrix.h"
+#include "Arena.h"
+#include "Gemm.h"
 
 
 namespace cpu {
 
 
 Matrix::Matrix(int h, int w) : w(w), h(h) {
-    data = (float*)malloc(w * h * sizeof(float));
-    for (int i = 0; i < w * h; i++) {
-        data[i] = 0.f;
-    }
+    data = static_cast<float*>(alignedAlloc(w * h * sizeof(float)));
+    memset(data, 0, w * h * sizeof(float));
 }
 
 
 Matrix::Matrix(const Matrix& m) : w(m.w), h(m.h) {
-    data = (float*)malloc(w * h * sizeof(float));
-    for (int i = 0; i < w * h; i++) {
-        data[i] = m.data[i];
-    }
+    data = static_cast<float*>(alignedAlloc(w * h * sizeof(float)));
+    memcpy(data, m.data, w * h * sizeof(float));
 }
 
 
 Matrix& Matrix::operator=(const Matrix& m) {
     if (this != &m) {
+        if (w * h != m.w * m.h || data == nullptr) {
+            alignedFree(data);
+            data = static_cast<float*>(alignedAlloc(m.w * m.h * sizeof(float)));
+        }
         w = m.w;
         h = m.h;
-        free(data);
-        data = (float*)malloc(w * h * sizeof(float));
         memcpy(data, m.data, w * h * sizeof(float));
     }
     return *this;
@@ -34,53 +34,40 @@ Matrix& Matrix::operator=(const Matrix& m) {
 
 
 Matrix::~Matrix() {
-    free(data);
-}
-
-
-float& Matrix::operator()(int row, int col) {
-    if (row >= h)
-        throw std::runtime_error("Overindexing Matrix. Rows: " + std::to_string(h + 1) + ", index: " + std::to_string(row));
-    if (col >= w)
-        throw std::runtime_error("Overindexing Matrix. Columns: " + std::to_string(w + 1) + ", index: " + std::to_string(col));
-
-    return data[row * w + col];
-}
-
-const float& Matrix::operator()(int row, int col) const {
-    if (row >= h)
-        throw std::runtime_error("Overindexing Matrix. Rows: " + std::to_string(h + 1) + ", index: " + std::to_string(row));
-    if (col >= w)
-        throw std::runtime_error("Overindexing Matrix. Columns: " + std::to_string(w + 1) + ", index: " + std::to_string(col));
-
-    return data[row * w + col];
+    alignedFree(data);
 }
 
 
 Matrix Matrix::mul(const Matrix& m) {
-    Matrix r(m.w, h);
-    for (int i = 0; i < h; i++) {
-        for (int j = 0; j < m.w; j++) {
-            r(i, j) = 0.0f;
-            for (int k = 0; k < m.h; k++) {
-                r(i, j) += (*this)(i, k) * m(k, j);
-            }
-        }
-    }
+    if (m.h != w)
+        throw std::runtime_error("Trying to multiply Matrices with incompatible sizes: (" + std::to_string(h) + ", " + std::to_string(w) + ") x (" + std::to_string(m.h) + ", " + std::to_string(m.w) + ")");
+    Matrix r(h, m.w);
+    sgemm(false, false, h, m.w, w, 1.0f, data, w, m.data, m.w, 0.0f, r.data, r.w);
     return r;
 }
 
 
 Vector Matrix::mul(const Vector& v) {
+    if (v.s != w)
+        throw std::runtime_error("Trying to multiply Matrix and Vector with incompatible sizes: (" + std::to_string(h) + ", " + std::to_string(w) + ") x " + std::to_string(v.s));
     Vector r(h);
-    for (int i = 0; i < h; i++) {
-        r[i] = 0.0f;
-        for (int j = 0; j < v.s; j++) {
-            r[i] += (*this)(i, j) * v[j];
-        }
-    }
+    sgemv(false, h, w, 1.0f, data, w, v.data, 0.0f, r.data);
     return r;
 }
 
 
-}
\ No newline at end of file
+// C = act(alpha * op(A) * op(B) + beta * C + bias), where op(X) is X or its transpose
+void gemm(bool transA, bool transB, float alpha, ConstMatrixView A, ConstMatrixView B, float beta, MatrixView C,
+    const float* bias, Activation act) {
+    int M = transA ? A.w : A.h;
+    int K = transA ? A.h : A.w;
+    int N = transB ? B.h : B.w;
+    if ((transB ? B.w : B.h) != K || C.h != M || C.w != N)
+        throw std::runtime_error("Incompatible gemm shapes: (" + std::to_string(M) + ", " + std::to_string(K) + ") x (" +
+            std::to_string(transB ? B.w : B.h) + ", " + std::to_string(N) + ") -> (" + std::to_string(C.h) + ", " + std::to_string(C.w) + ")");
+
+    sgemm(transA, transB, M, N, K, alpha, A.data, A.stride, B.data, B.stride, beta, C.data, C.stride, bias, act);
+}
+
+
+}
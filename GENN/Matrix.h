@@ -1,16 +1,58 @@
 #pragma once
 
 #include "Vector.h"
+#include "Activation.h"
 
 
 namespace cpu {
 
 
+template <typename T>
+class MatrixViewT {
+public:
+    T* data = nullptr;
+    int w = 0;
+    int h = 0;
+    int stride = 0;
+
+    MatrixViewT() = default;
+    MatrixViewT(T* data, int h, int w) : data(data), w(w), h(h), stride(w) {}
+    MatrixViewT(T* data, int h, int w, int stride) : data(data), w(w), h(h), stride(stride) {}
+    template <typename U>
+    MatrixViewT(const MatrixViewT<U>& m) : data(m.data), w(m.w), h(m.h), stride(m.stride) {}
+
+    T& operator() (int row, int col) const {
+#ifdef GENN_CHECKED
+        if (row < 0 || row >= h)
+            indexError("Matrix", "Rows", h, row);
+        if (col < 0 || col >= w)
+            indexError("Matrix", "Columns", w, col);
+#endif
+        return data[row * stride + col];
+    }
+
+    T* row(int r) const {
+#ifdef GENN_CHECKED
+        if (r < 0 || r >= h)
+            indexError("Matrix", "Rows", h, r);
+#endif
+        return data + r * stride;
+    }
+
+    VectorViewT<T> rowView(int r) const { return VectorViewT<T>(row(r), w); }
+    MatrixViewT rows(int first, int n) const { return MatrixViewT(row(first), n, w, stride); }
+    bool contiguous() const { return stride == w; }
+};
+
+typedef MatrixViewT<float> MatrixView;
+typedef MatrixViewT<const float> ConstMatrixView;
+
+
 class Matrix {
 public:
-    float* data;
-    int w;
-    int h;
+    float* data = nullptr;
+    int w = 0;
+    int h = 0;
 
     Matrix() = default;
     Matrix(int h, int w);
@@ -18,12 +60,36 @@ public:
     Matrix& operator= (const Matrix& m);
     ~Matrix();
 
-    float& operator() (int row, int col);
-    const float& operator() (int row, int col) const;
+    float& operator() (int row, int col) {
+#ifdef GENN_CHECKED
+        if (row < 0 || row >= h)
+            indexError("Matrix", "Rows", h, row);
+        if (col < 0 || col >= w)
+            indexError("Matrix", "Columns", w, col);
+#endif
+        return data[row * w + col];
+    }
+
+    const float& operator() (int row, int col) const {
+#ifdef GENN_CHECKED
+        if (row < 0 || row >= h)
+            indexError("Matrix", "Rows", h, row);
+        if (col < 0 || col >= w)
+            indexError("Matrix", "Columns", w, col);
+#endif
+        return data[row * w + col];
+    }
+
+    MatrixView view() { return MatrixView(data, h, w); }
+    ConstMatrixView view() const { return ConstMatrixView(data, h, w); }
 
     Matrix mul(const Matrix& m);
     Vector mul(const Vector& v);
 };
 
 
+void gemm(bool transA, bool transB, float alpha, ConstMatrixView A, ConstMatrixView B, float beta, MatrixView C,
+    const float* bias = nullptr, Activation act = Activation::linear);
+
+
 }
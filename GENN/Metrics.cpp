@@ -0,0 +1,92 @@
+#include "pch.h"
+#include "Metrics.h"
+
+
+namespace nn {
+
+
+ConfusionMatrix::ConfusionMatrix(int classes) : n(classes), counts(classes * classes), predicted(classes), actual(classes) {
+    reset();
+}
+
+
+void ConfusionMatrix::reset() {
+    for (auto& c : counts) {
+        c.store(0, std::memory_order_relaxed);
+    }
+    for (int i = 0; i < n; i++) {
+        predicted[i].store(0, std::memory_order_relaxed);
+        actual[i].store(0, std::memory_order_relaxed);
+    }
+    totalCount.store(0, std::memory_order_relaxed);
+    correctCount.store(0, std::memory_order_relaxed);
+}
+
+
+// Totals are bumped before the cell and the correct count, so a reader that loads the
+// cell first never sees it exceed its totals
+void ConfusionMatrix::add(int prediction, int label) {
+    if (prediction < 0 || prediction >= n || label < 0 || label >= n)
+        throw std::runtime_error("Prediction " + std::to_string(prediction) + " or label " + std::to_string(label) + " is outside " + std::to_string(n) + " classes");
+    predicted[prediction].fetch_add(1, std::memory_order_relaxed);
+    actual[label].fetch_add(1, std::memory_order_relaxed);
+    totalCount.fetch_add(1, std::memory_order_relaxed);
+    counts[prediction * n + label].fetch_add(1, std::memory_order_release);
+    if (prediction == label)
+        correctCount.fetch_add(1, std::memory_order_release);
+}
+
+
+int ConfusionMatrix::count(int prediction, int label) const {
+    return counts[prediction * n + label].load(std::memory_order_acquire);
+}
+
+
+int ConfusionMatrix::total() const {
+    return totalCount.load(std::memory_order_relaxed);
+}
+
+
+int ConfusionMatrix::correct() const {
+    return correctCount.load(std::memory_order_acquire);
+}
+
+
+float ConfusionMatrix::accuracy() const {
+    int c = correct();
+    int t = total();
+    return t > 0 ? static_cast<float>(c) / t : 0.0f;
+}
+
+
+float ConfusionMatrix::precision(int c) const {
+    int tp = count(c, c);
+    int p = predicted[c].load(std::memory_order_relaxed);
+    return p > 0 ? static_cast<float>(tp) / p : 0.0f;
+}
+
+
+float ConfusionMatrix::recall(int c) const {
+    int tp = count(c, c);
+    int a = actual[c].load(std::memory_order_relaxed);
+    return a > 0 ? static_cast<float>(tp) / a : 0.0f;
+}
+
+
+float ConfusionMatrix::f1(int c) const {
+    float p = precision(c);
+    float r = recall(c);
+    return p + r > 0.0f ? 2.0f * p * r / (p + r) : 0.0f;
+}
+
+
+cpu::Matrix ConfusionMatrix::toMatrix() const {
+    cpu::Matrix m(n, n);
+    for (int i = 0; i < n * n; i++) {
+        m.data[i] = static_cast<float>(counts[i].load(std::memory_order_relaxed));
+    }
+    return m;
+}
+
+
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include "Matrix.h"
+
+
+namespace nn {
+
+
+// Counts of (prediction, label) pairs together with the row, column and diagonal totals,
+// so accuracy and per-class precision/recall/F1 are O(1) to query. add() may run
+// concurrently with readers and with other writers.
+class ConfusionMatrix {
+public:
+    explicit ConfusionMatrix(int classes = 10);
+    ConfusionMatrix(const ConfusionMatrix&) = delete;
+    ConfusionMatrix& operator= (const ConfusionMatrix&) = delete;
+
+    int classes() const { return n; }
+
+    void reset();
+    void add(int prediction, int label);
+
+    int count(int prediction, int label) const;
+    int total() const;
+    int correct() const;
+
+    float accuracy() const;
+    float precision(int c) const;
+    float recall(int c) const;
+    float f1(int c) const;
+
+    // Rows are predictions and columns are labels
+    cpu::Matrix toMatrix() const;
+
+private:
+    int n;
+    std::vector<std::atomic<int>> counts;
+    std::vector<std::atomic<int>> predicted;
+    std::vector<std::atomic<int>> actual;
+    std::atomic<int> totalCount;
+    std::atomic<int> correctCount;
+};
+
+
+}
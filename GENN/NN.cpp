@@ -1,6 +1,7 @@
 #include "pch.h"
 #include "NN.h"
 #include "math.h"
+#include <sstream>
 
 namespace nn {
 
@@ -43,17 +44,55 @@ void Network::initLayers() {
 
     }
 #else
-    layers = {
-        cpu::DenseLayer(784, 64, cpu::Activation::sigmoid),
-        cpu::DenseLayer(64, 64, cpu::Activation::sigmoid),
-        cpu::DenseLayer(64, 10, cpu::Activation::linear, true)
-    };
+    if (topology.empty())
+        throw std::runtime_error("The topology has no layers");
+    layers.clear();
+    int in = inputSize;
+    for (int i = 0; i < (int)topology.size(); i++) {
+        const LayerSpec& spec = topology[i];
+        if (in <= 0 || spec.outputs <= 0)
+            throw std::runtime_error("Invalid width for layer " + std::to_string(i));
+        layers.emplace_back(in, spec.outputs, spec.activation, i + 1 == (int)topology.size());
+        in = spec.outputs;
+    }
+    reserveBatch(batchSize);
+    std::mt19937 gen{ seed };
+    for (int i = 0; i < (int)layers.size(); i++) {
+        layers[i].initParameters(gen, i > 0 ? layers[i - 1].activation : cpu::Activation::sigmoid);
+    }
+    setClasses(layers.back().outSize);
+    publishIfIdle();
 #endif // CUDA
 
 
 }
 
 
+#ifndef CUDA
+std::vector<LayerSpec> parseTopology(const std::string& spec) {
+    std::vector<LayerSpec> topology;
+    std::stringstream in(spec);
+    std::string item;
+    bool named = false;
+    while (std::getline(in, item, ',')) {
+        size_t colon = item.find(':');
+        std::string width = item.substr(0, colon);
+        if (width.empty() || width.size() > 9 || width.find_first_not_of("0123456789") != std::string::npos || std::stoi(width) == 0)
+            throw std::runtime_error("Invalid layer width '" + width + "' in " + spec);
+        named = colon != std::string::npos;
+        topology.push_back({ std::stoi(width), named ? cpu::activationFromName(item.substr(colon + 1)) : cpu::Activation::sigmoid });
+    }
+    if (topology.empty())
+        throw std::runtime_error("Empty topology");
+    if (!named) {
+        topology.back().activation = cpu::Activation::linear;
+    }
+    return topology;
+}
+#endif // !CUDA
+
+
+#ifdef CUDA
 void Network::forward(int p) {
     layers[0].input = getImage(p);
     for (int i = 0; i < layers.size(); ++i) {
@@ -74,55 +113,326 @@ void Network::backward(int label) {
         }
     }
 }
+#else
+void Network::forward(int p) {
+    for (auto& layer : layers) {
+        layer.setBatchSize(1);
+    }
+    if (status == NetworkStatus::training) {
+        images.normalize(p, normalization, input.row(0));
+    }
+    else {
+        testImages.normalize(testOrder[p], normalization, input.row(0));
+    }
+    for (auto& layer : layers) {
+        layer.forward();
+    }
+}
 
-void Network::step() {
+
+void Network::backward(int label) {
+    layers.back().initBackProp(label);
+    for (int i = static_cast<int>(layers.size()) - 1; i >= 0; --i) {
+        layers[i].backward();
+    }
+}
+
+
+static size_t activationSize(const std::vector<cpu::DenseLayer>& layers, int n) {
+    size_t size = cpu::Arena::padded(n * layers[0].inSize);
     for (auto& layer : layers) {
-        layer.step(learningRate);
+        size += 2 * cpu::Arena::padded(n * layer.outSize);
     }
+    return size;
 }
 
-void Network::zeroGrad() {
+
+// Buffer plan: activation k is the output of layer k - 1 and the input of layer k, and
+// likewise for its gradient, so adjacent layers share one buffer. The network input is
+// the returned block, which receives normalized dataset rows; layer 0 has no input
+// gradient to produce.
+static cpu::MatrixView planActivations(std::vector<cpu::DenseLayer>& layers, cpu::Arena& arena, int n) {
+    cpu::MatrixView x(arena.allocate(n * layers[0].inSize), n, layers[0].inSize);
+    cpu::ConstMatrixView in = x;
+    cpu::MatrixView dIn;
     for (auto& layer : layers) {
-        layer.zeroGrad();
+        cpu::MatrixView out(arena.allocate(n * layer.outSize), n, layer.outSize);
+        cpu::MatrixView dOut(arena.allocate(n * layer.outSize), n, layer.outSize);
+        layer.bindActivations(in, dIn, out, dOut);
+        in = out;
+        dIn = dOut;
     }
+    return x;
 }
 
 
-void Network::setPosition(int n) {
-    std::lock_guard<std::mutex> guard(nnMutex);
-    currentPredictions.emplace_back(n);
+#ifdef GENN_PROFILE
+// Nominal work of the batched products: the forward pass reads W and the input and writes
+// the output; the backward pass also reads and writes gradW and, past layer 0, the input
+// gradient
+static long long forwardFlops(const cpu::DenseLayer& l, int n) {
+    return 2LL * n * l.outSize * l.inSize;
+}
+
+
+static long long forwardBytes(const cpu::DenseLayer& l, int n) {
+    return sizeof(float) * (static_cast<long long>(l.outSize) * (l.inSize + 1) + static_cast<long long>(n) * (l.inSize + l.outSize));
+}
+
+
+static long long backwardFlops(const cpu::DenseLayer& l, int n, bool inputGradient) {
+    return forwardFlops(l, n) * (inputGradient ? 2 : 1);
+}
+
+
+static long long backwardBytes(const cpu::DenseLayer& l, int n, bool inputGradient) {
+    long long weights = static_cast<long long>(l.outSize) * (l.inSize + 1);
+    long long activations = static_cast<long long>(n) * (l.inSize + 2 * l.outSize + (inputGradient ? l.inSize : 0));
+    return sizeof(float) * ((inputGradient ? 3 : 2) * weights + activations);
+}
+#endif // GENN_PROFILE
+
+
+static void runShard(std::vector<cpu::DenseLayer>& layers, cpu::ConstMatrixView x, const int* labels, cpu::Profiler& profiler) {
+    layers[0].batchInput = x;
+    for (auto& layer : layers) {
+        layer.setBatchSize(x.h);
+    }
+    for (int i = 0; i < (int)layers.size(); i++) {
+        GENN_PROFILE_SCOPE(&profiler, cpu::Phase::forward, i, forwardFlops(layers[i], x.h), forwardBytes(layers[i], x.h));
+        layers[i].forwardBatch();
+    }
+    layers.back().initBackPropBatch(labels);
+    for (int i = static_cast<int>(layers.size()) - 1; i >= 0; --i) {
+        GENN_PROFILE_SCOPE(&profiler, cpu::Phase::backward, i, backwardFlops(layers[i], x.h, i > 0), backwardBytes(layers[i], x.h, i > 0));
+        layers[i].backwardBatch();
+    }
+    (void)profiler;
+}
+
+
+void Network::reserveBatch(int n) {
+    if (!layers.empty() && n <= layers[0].maxBatchSize)
+        return;
+    size_t size = activationSize(layers, n);
+    for (auto& layer : layers) {
+        size += layer.parameterSize();
+    }
+    cpu::Arena next(size);
+    for (auto& layer : layers) {
+        layer.bindParameters(next);
+    }
+    input = planActivations(layers, next, n);
+    arena = std::move(next);
+    replicas.clear();
+}
+
+
+// Worker t > 0 trains on a replica whose layers share W and b with the master layers
+// but own their activations and gradient accumulators; worker 0 uses the master layers.
+void Network::reserveWorkers(int n) {
+    if (!pool || pool->size() != threads) {
+        pool.reset(new cpu::ThreadPool(threads));
+        replicas.clear();
+    }
+    if ((int)replicas.size() == threads - 1 && (replicas.empty() || n <= replicas[0].layers[0].maxBatchSize))
+        return;
+
+    replicas.clear();
+    replicas.resize(threads - 1);
+    for (auto& replica : replicas) {
+        size_t size = activationSize(layers, n);
+        for (auto& layer : layers) {
+            size += layer.gradientSize();
+        }
+        replica.arena = cpu::Arena(size);
+        replica.layers = layers;
+        for (auto& layer : replica.layers) {
+            layer.bindGradients(replica.arena);
+        }
+        planActivations(replica.layers, replica.arena, n);
+    }
+}
+
+
+void Network::refreshHalfWeights() {
+    size_t size = 0;
+    for (auto& layer : layers) {
+        size += cpu::Arena::padded((static_cast<size_t>(layer.outSize) * layer.inSize + 1) / 2);
+    }
+    if (precision != cpu::Precision::fp32 && halfWeights.capacity() < size) {
+        halfWeights = cpu::Arena(size);
+    }
+    halfWeights.reset();
+    for (int l = 0; l < (int)layers.size(); l++) {
+        cpu::DenseLayer& layer = layers[l];
+        const uint16_t* Wh = nullptr;
+        if (precision != cpu::Precision::fp32) {
+            size_t n = static_cast<size_t>(layer.outSize) * layer.inSize;
+            uint16_t* dst = reinterpret_cast<uint16_t*>(halfWeights.allocate((n + 1) / 2));
+            cpu::toHalf(precision, layer.W.data, dst, n);
+            Wh = dst;
+        }
+        for (int t = 0; t <= (int)replicas.size(); t++) {
+            shardLayers(t)[l].precision = precision;
+            shardLayers(t)[l].Wh = Wh;
+        }
+    }
+}
+
+
+std::vector<cpu::DenseLayer>& Network::shardLayers(int t) {
+    return t == 0 ? layers : replicas[t - 1].layers;
+}
+
+
+
+void Network::forwardBatch(int p, int n) {
+    reserveBatch(n);
+    images.normalize(p, n, normalization, input);
+    layers[0].batchInput = input;
+    for (auto& layer : layers) {
+        layer.setBatchSize(n);
+    }
+    for (auto& layer : layers) {
+        layer.forwardBatch();
+    }
+}
+
+
+void Network::backwardBatch(const int* labels) {
+    layers.back().initBackPropBatch(labels);
+    for (int i = static_cast<int>(layers.size()) - 1; i >= 0; --i) {
+        layers[i].backwardBatch();
+    }
+}
+
+
+// Splits the minibatch into one contiguous shard per thread and leaves the summed
+// gradient in the master layers
+void Network::trainBatch(cpu::ConstMatrixView x, const int* labels) {
+    int n = x.h;
+    if (threads <= 1) {
+        reserveBatch(n);
+        runShard(layers, x, labels, profiler);
+        return;
+    }
+
+    int shard = (n + threads - 1) / threads;
+    reserveBatch(shard);
+    reserveWorkers(shard);
+    pool->run(threads, [&](int t) {
+        int begin = std::min(n, t * shard);
+        int end = std::min(n, begin + shard);
+        runShard(shardLayers(t), x.rows(begin, end - begin), labels + begin, profiler);
+    });
+    reduceGradients();
+}
+
+
+// Each thread owns a fixed slice of every gradient and adds the replicas in index order,
+// so the sum does not depend on scheduling; the replicas are zeroed in the same pass
+void Network::reduceGradients() {
+#ifdef GENN_PROFILE
+    long long gradients = 0;
+    for (auto& layer : layers) {
+        gradients += static_cast<long long>(layer.outSize) * (layer.inSize + 1);
+    }
+    GENN_PROFILE_SCOPE(&profiler, cpu::Phase::reduce, -1, gradients * (long long)replicas.size(),
+        gradients * sizeof(float) * (1 + 2 * (long long)replicas.size()));
+#endif // GENN_PROFILE
+    pool->run(threads, [&](int t) {
+        for (int l = 0; l < (int)layers.size(); l++) {
+            cpu::DenseLayer& layer = layers[l];
+            int size = layer.gradW.h * layer.gradW.w;
+            int begin = static_cast<int>(static_cast<long long>(size) * t / threads);
+            int end = static_cast<int>(static_cast<long long>(size) * (t + 1) / threads);
+            for (auto& replica : replicas) {
+                float* src = replica.layers[l].gradW.data;
+                float* dst = layer.gradW.data;
+                for (int i = begin; i < end; i++) {
+                    dst[i] += src[i];
+                    src[i] = 0.0f;
+                }
+                if (t == 0) {
+                    float* srcb = replica.layers[l].gradb.data;
+                    for (int i = 0; i < layer.gradb.s; i++) {
+                        layer.gradb.data[i] += srcb[i];
+                        srcb[i] = 0.0f;
+                    }
+                }
+            }
+        }
+    });
+}
+#endif // CUDA
+
+
+// Time spent waiting for a mutex that the UI or a checkpoint request may hold
+static std::unique_lock<std::mutex> lockTimed(std::mutex& mutex, cpu::Profiler& profiler) {
+    GENN_PROFILE_SCOPE(&profiler, cpu::Phase::lockWait, -1);
+    (void)profiler;
+    return std::unique_lock<std::mutex>(mutex);
+}
+
+
+// On the CPU the optimizer also zeroes the gradients in its update pass
+void Network::step() {
+#ifdef CUDA
+    for (auto& layer : layers) {
+        layer.step(learningRate);
+    }
+#else
+    cpu::Optimizer& o = getOptimizer();
+    o.profiler = &profiler;
+    o.step(layers);
+    refreshHalfWeights();
+#endif // CUDA
+}
+
+void Network::zeroGrad() {
+    for (int i = 0; i < (int)layers.size(); i++) {
+        GENN_PROFILE_SCOPE(&profiler, cpu::Phase::zeroGrad, i);
+        layers[i].zeroGrad();
+    }
 }
 
 
 int Network::getPosition() {
-    return static_cast<int>(currentPredictions.size());
+    return static_cast<int>(telemetry.snapshot().position);
 }
 
 
-float Network::meanLoss() {
-    std::lock_guard<std::mutex> guard(nnMutex);
-    auto b = loss.size() >= (int)1000 ? loss.end() - 1000 : loss.begin();
-    return std::accumulate(b, loss.end(), 0.0f) / std::min(1000.0f, static_cast<float>(loss.size()));
+int Network::getEpoch() {
+    return telemetry.snapshot().epoch;
 }
 
 
-void Network::setLoss(float loss) {
-    std::lock_guard<std::mutex> guard(nnMutex);
-    this->loss.emplace_back(loss);
+float Network::meanLoss() {
+    return telemetry.snapshot().meanLoss;
 }
 
+
+// Mean loss of each consecutive block of Telemetry::lossWindow samples
 std::vector<float> Network::getLoss() {
-    std::lock_guard<std::mutex> guard(nnMutex);
-    return loss;
+    return telemetry.lossHistory();
 }
 
 
 void Network::startTraining() {
     status = NetworkStatus::training;
-    currentPredictions.clear();
-    loss.clear();
+#ifdef CUDA
+    telemetry.reset(static_cast<int>(labels.size()));
+#else
+    telemetry.reset(trainSource ? trainSource->size() : 0);
+#endif // CUDA
     initLayers();
     zeroGrad();
+#ifndef CUDA
+    if (optimizer) {
+        optimizer->reset();
+    }
+#endif // !CUDA
     train();
 }
 
@@ -146,7 +456,7 @@ void Network::resumeTraining() {
 
 
 bool Network::isTraining() {
-    std::lock_guard<std::mutex> guard(nnMutex);
+    std::unique_lock<std::mutex> guard = lockTimed(nnMutex, profiler);
     return status == NetworkStatus::training;
 }
 
@@ -156,6 +466,7 @@ bool Network::isPaused() {
     return status == NetworkStatus::paused;
 }
 
+#ifdef CUDA
 pf::Vector& Network::getImage(int p) {
     if (status == NetworkStatus::training) {
         return images[p];
@@ -164,6 +475,7 @@ pf::Vector& Network::getImage(int p) {
         return testImages[testOrder[p]];
     }
 }
+#endif // CUDA
 
 int Network::getLabel(int p) {
     if (status == NetworkStatus::training) {
@@ -174,92 +486,131 @@ int Network::getLabel(int p) {
     }
 }
 
-std::vector<int> Network::getPredictions(int n) {
-    std::lock_guard<std::mutex> guard(nnMutex);
-    int s = std::min((int)currentPredictions.size(), n);
-    return std::vector<int>(currentPredictions.end() - n, currentPredictions.end());
+std::vector<Prediction> Network::getPredictions(int n) {
+    return telemetry.latestPredictions(n);
 }
 
 
-cpu::Vector prepareInput(const cpu::Matrix& image) {
-    cpu::Vector input(image.w * image.h);
-    memcpy(input.data, image.data, input.s * sizeof(float));
-    for (int i = 0; i < input.s; i++) {
-        input[i] = (input[i] / 255.0f - 0.1307f) / 0.3081f;
+static void checkClasses(const std::vector<int>& labels, int classes) {
+    for (int label : labels) {
+        if (label < 0 || label >= classes)
+            throw std::runtime_error("Label out of range: " + std::to_string(label));
     }
-    return input;
 }
 
 
-void Network::setTrainData(const std::vector<cpu::Matrix>& images, const std::vector<int>& labels) {
+static void checkLabels(const ImageSet& images, const std::vector<int>& labels, int classes) {
+    if ((int)labels.size() != images.size())
+        throw std::runtime_error("Image and label counts differ: " + std::to_string(images.size()) + " vs " + std::to_string(labels.size()));
+    checkClasses(labels, classes);
+}
+
+
+int Network::classes() const {
 #ifdef CUDA
-    this->images = std::vector<cuda::Vector>(images.size());
-    for (int i = 0; i < (int)images.size(); i++) {
-        cpu::Vector pInput = prepareInput(images[i]);
-        cuda::toGpu(&this->images[i].data, &pInput.data, images[i].w * images[i].h);
-    }
+    return 10;
 #else
-    this->images = std::vector<cpu::Vector>(images.size());
-    for (int i = 0; i < (int)images.size(); i++) {
-        this->images[i] = prepareInput(images[i]);
+    return layers.back().outSize;
+#endif // CUDA
+}
+
+
+#ifndef CUDA
+static void checkInputs(int pixels, int inputs, const char* what) {
+    if (pixels != inputs)
+        throw std::runtime_error(std::string(what) + " have " + std::to_string(pixels) + " pixels but the network takes " + std::to_string(inputs) + " inputs");
+}
+#endif // !CUDA
+
+
+#ifdef CUDA
+static std::vector<cuda::Vector> toGpu(const ImageSet& images, const Normalization& norm) {
+    std::vector<cuda::Vector> r(images.size());
+    cpu::Vector pInput(images.pixels());
+    for (int i = 0; i < images.size(); i++) {
+        images.normalize(i, norm, pInput.data);
+        cuda::toGpu(&r[i].data, &pInput.data, images.pixels());
+    }
+    return r;
 }
 #endif // CUDA
+
+
+void Network::setTrainData(const ImageSet& images, const std::vector<int>& labels) {
+    checkLabels(images, labels, classes());
+#ifndef CUDA
+    checkInputs(images.pixels(), inputSize, "Training images");
+#endif // !CUDA
+    if (measureNormalization) {
+        normalization = images.measure();
+    }
+#ifdef CUDA
+    this->images = toGpu(images, normalization);
+#else
+    this->images = images;
+    trainSource = std::make_shared<MemorySource>(images, labels);
+    publishIfIdle();
+#endif // CUDA
     this->labels = labels;
 }
 
-void Network::setTestData(const std::vector<cpu::Matrix>& images, const std::vector<int>& labels) {
+
+#ifndef CUDA
+// The source is read only while training; measureNormalization applies to in-memory sets
+void Network::setTrainSource(std::shared_ptr<SampleSource> source) {
+    checkInputs(source->pixels(), inputSize, "Training images");
+    images = ImageSet();
+    labels.clear();
+    trainSource = std::move(source);
+}
+#endif // !CUDA
+
+
+void Network::setTestData(const ImageSet& images, const std::vector<int>& labels) {
+    checkLabels(images, labels, classes());
 #ifdef CUDA
-    this->testImages = std::vector<cuda::Vector>(images.size());
-    for (int i = 0; i < (int)images.size(); i++) {
-        cpu::Vector pInput = prepareInput(images[i]);
-        cuda::toGpu(&this->testImages[i].data, &pInput.data, images[i].w * images[i].h);
-    }
+    this->testImages = toGpu(images, normalization);
 #else
-    this->testImages = std::vector<cpu::Vector>(images.size());
-    for (int i = 0; i < (int)images.size(); i++) {
-        this->testImages[i] = prepareInput(images[i]);
-    }
+    checkInputs(images.pixels(), inputSize, "Test images");
+    std::lock_guard<std::mutex> guard(testMutex);
+    this->testImages = images;
 #endif // CUDA
     this->testLabels = labels;
 }
 
 
+void Network::setTrainData(const std::vector<cpu::Matrix>& images, const std::vector<int>& labels) {
+    setTrainData(ImageSet(images), labels);
+}
+
+
+void Network::setTestData(const std::vector<cpu::Matrix>& images, const std::vector<int>& labels) {
+    setTestData(ImageSet(images), labels);
+}
+
+
 float Network::trainPrecision() {
-    int p = getPosition();
-    int size = static_cast<int>(images.size());
-    int start = (p / size) * size;
-    int acc = 0;
-    for (int i = 0; i < p % size; i++) {
-        acc += currentPredictions[start + i] == labels[i] ? 1 : 0;
-    }
-    return static_cast<float>(acc) / (p % size);
+    return telemetry.snapshot().accuracy();
 }
 
 float Network::testPrecision() {
-    float x = 0;
-    float sum = 0;
-    for (int i = 0; i < confusionMatrix.h; i++) {
-        for (int j = 0; j < confusionMatrix.w; j++) {
-            sum += confusionMatrix(i, j);
-        }
-        x += confusionMatrix(i, i);
-    }
-    return x / (sum + 1e-6f);
+    return testConfusion()->accuracy();
+}
+
+
+std::shared_ptr<const ConfusionMatrix> Network::testConfusion() const {
+    return std::atomic_load(&confusion);
 }
 
 
 void Network::train() {
+#ifdef CUDA
     int n = getPosition();
     while (isTraining()) {
-        if (n % (int)images.size() == 0 && n > 0) {
-            ++epoch;
-        }
-
         int p = n % (int)images.size();
         forward(p);
         backward(getLabel(p));
-        setPosition(layers.back().argmax());
-        setLoss(layers.back().loss(getLabel(p)));
+        telemetry.record(p, layers.back().argmax(), getLabel(p), layers.back().loss(getLabel(p)));
 
         if (n % 50 == 0 && n > 0) {
             step();
@@ -271,6 +622,70 @@ void Network::train() {
 
         ++n;
     }
+#else
+    if (!trainSource)
+        throw std::runtime_error("No training data");
+    long long n = telemetry.snapshot().position;
+    loader.reset(new BatchLoader(trainSource, normalization, batchSize, n, seed, loading));
+    refreshHalfWeights();
+    {
+        std::lock_guard<std::mutex> guard(checkpointMutex);
+        trainerRunning = true;
+    }
+    long long steps = 0;
+    while (isTraining()) {
+        const Batch* next;
+        {
+            GENN_PROFILE_SCOPE(&profiler, cpu::Phase::load, -1, 0, (long long)batchSize * layers[0].inSize * (1 + sizeof(float)));
+            next = &loader->next();
+        }
+        const Batch& batch = *next;
+        for (int i = 0; i < batch.count; i++) {
+            if (batch.labels[i] < 0 || batch.labels[i] >= layers.back().outSize)
+                throw std::runtime_error("Label out of range: " + std::to_string(batch.labels[i]));
+        }
+        trainBatch(batch.x, batch.labels.data());
+        for (int t = 0, q = 0; t < std::max(1, threads); t++) {
+            cpu::DenseLayer& out = shardLayers(t).back();
+            for (int i = 0; i < out.batchSize; i++, q++) {
+                telemetry.record(batch.samples[q], out.batchPrediction[i], batch.labels[q], out.batchLoss[i]);
+            }
+        }
+
+        step();
+        if (publishInterval > 0 && ++steps % publishInterval == 0) {
+            publishedWeights.publish(layers, normalization, n + batch.count);
+        }
+        if (n / 10000 != (n + batch.count) / 10000) {
+            startEvaluation(10000);
+        }
+        if (checkpointInterval > 0 && n / checkpointInterval != (n + batch.count) / checkpointInterval) {
+            writeCheckpoint(checkpointPath, n + batch.count);
+        }
+
+        n += batch.count;
+        std::string requested;
+        {
+            std::unique_lock<std::mutex> guard = lockTimed(checkpointMutex, profiler);
+            requested.swap(checkpointRequest);
+        }
+        if (!requested.empty()) {
+            writeCheckpoint(requested, n);
+        }
+    }
+    loader.reset();
+    publishedWeights.publish(layers, normalization, n);
+
+    std::string requested;
+    {
+        std::lock_guard<std::mutex> guard(checkpointMutex);
+        trainerRunning = false;
+        requested.swap(checkpointRequest);
+    }
+    if (!requested.empty()) {
+        writeCheckpoint(requested, n);
+    }
+#endif // CUDA
 }
 
 int Network::predict(int p) {
@@ -279,18 +694,223 @@ int Network::predict(int p) {
 }
 
 
+#ifdef CUDA
 float Network::test(int n) {
     int correct = 0;
-    std::random_shuffle(testOrder.begin(), testOrder.end());
-    confusionMatrix = cpu::Matrix(10, 10);
+    std::shuffle(testOrder.begin(), testOrder.end(), shuffleGen);
+    confusion->reset();
     for (int i = 0; i < n; i++) {
         int pred = predict(i);
         if (pred == getLabel(i))
             ++correct;
-        confusionMatrix(pred, getLabel(i)) += 1.0f;
+        confusion->add(pred, getLabel(i));
     }
     return static_cast<float>(correct) / n;
 }
+#else
+cpu::Optimizer& Network::getOptimizer() {
+    if (!optimizer) {
+        optimizer.reset(new cpu::Sgd(learningRate));
+    }
+    return *optimizer;
+}
+
+
+// Classifies n test rows with the latest published weights; the caller holds testMutex
+float Network::evaluatePublished(int n) {
+    if (!evaluator || evaluator->threads() != std::max(1, threads)) {
+        evaluator.reset(new Evaluator(threads, seed));
+    }
+    {
+        PinnedWeights w = publishedWeights.acquire();
+        evaluator->snapshot(w->layers, w->normalization);
+    }
+    return evaluator->evaluate(testImages, testLabels, n, *confusion);
+}
+
+
+// Publishes the current weights and evaluates them in the background; skipped while the
+// previous evaluation is still running. Called by the trainer, which owns the weights.
+void Network::startEvaluation(int n) {
+    std::lock_guard<std::mutex> guard(evaluationMutex);
+    if (evaluation.valid()) {
+        if (evaluation.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            return;
+        evaluation.get();
+    }
+    publishedWeights.publish(layers, normalization, telemetry.snapshot().position);
+    evaluation = std::async(std::launch::async, [this, n] {
+        std::lock_guard<std::mutex> guard(testMutex);
+        return evaluatePublished(n);
+    });
+}
+
+
+void Network::waitEvaluation() {
+    std::lock_guard<std::mutex> guard(evaluationMutex);
+    if (evaluation.valid()) {
+        evaluation.get();
+    }
+}
+
+
+void Network::setClasses(int classes) {
+    checkClasses(labels, classes);
+    std::lock_guard<std::mutex> guard(testMutex);
+    checkClasses(testLabels, classes);
+    telemetry.setClasses(classes);
+    if (confusion->classes() != classes)
+        std::atomic_store(&confusion, std::make_shared<ConfusionMatrix>(classes));
+}
+
+
+// Publishes the current weights unless the trainer is running and owns them
+void Network::publishIfIdle() {
+    std::lock_guard<std::mutex> guard(checkpointMutex);
+    if (!trainerRunning) {
+        publishedWeights.publish(layers, normalization, telemetry.snapshot().position);
+    }
+}
+
+
+std::shared_ptr<const InferenceModel> Network::freeze() const {
+    PinnedWeights w = publishedWeights.acquire();
+    return std::make_shared<const InferenceModel>(w->layers, w->normalization);
+}
+
+
+std::shared_ptr<const QuantizedModel> Network::quantize(int samples) const {
+    PinnedWeights w = publishedWeights.acquire();
+    return std::make_shared<const QuantizedModel>(w->layers, w->normalization, images, samples);
+}
+
+
+void Network::saveCheckpoint(const std::string& filename) {
+    {
+        std::lock_guard<std::mutex> guard(checkpointMutex);
+        if (trainerRunning) {
+            checkpointRequest = filename;
+            return;
+        }
+    }
+    writeCheckpoint(filename, telemetry.snapshot().position);
+}
 
+
+// Copies the state on the calling thread, which must own the weights, and serializes and
+// writes the copy in the background; a previous write is finished first
+void Network::writeCheckpoint(const std::string& filename, long long position) {
+    TrainingState state;
+    state.position = position;
+    state.seed = seed;
+    state.batchSize = batchSize;
+    state.normalization = normalization;
+    if (optimizer) {
+        state.hasOptimizer = true;
+        state.optimizer = optimizer->config();
+        state.optimizerSteps = optimizer->steps();
+    }
+    std::shared_ptr<CheckpointBuilder> builder = std::make_shared<CheckpointBuilder>(state);
+    for (auto& layer : layers) {
+        builder->addLayer(layer);
+    }
+    if (optimizer) {
+        for (auto& buffer : optimizer->state()) {
+            builder->addTensor(buffer.name, buffer.data.data(), buffer.data.size());
+        }
+    }
+
+    waitCheckpoint();
+    checkpointWrite = std::async(std::launch::async, [builder, filename] {
+        writeFileAtomic(filename, builder->serialize());
+    });
 }
 
+
+void Network::waitCheckpoint() {
+    if (checkpointWrite.valid()) {
+        checkpointWrite.get();
+    }
+}
+
+
+// Replaces the layers and the optimizer state, so the trainer must have stopped or paused;
+// holding checkpointMutex keeps it from starting until the restore is done
+void Network::restore(const Checkpoint& checkpoint) {
+    if (checkpoint.layers().empty())
+        throw std::runtime_error("The checkpoint has no layers");
+    std::lock_guard<std::mutex> running(checkpointMutex);
+    if (trainerRunning)
+        throw std::runtime_error("Cannot restore a checkpoint while training; stop or pause first");
+    int inputs = checkpoint.layers()[0].in;
+    if (trainSource)
+        checkInputs(trainSource->pixels(), inputs, "Training images");
+    checkClasses(labels, checkpoint.layers().back().out);
+    {
+        std::lock_guard<std::mutex> guard(testMutex);
+        if (testImages.size() > 0)
+            checkInputs(testImages.pixels(), inputs, "Test images");
+        checkClasses(testLabels, checkpoint.layers().back().out);
+    }
+    waitEvaluation();
+    const TrainingState& state = checkpoint.state();
+    seed = state.seed;
+    batchSize = state.batchSize;
+    normalization = state.normalization;
+
+    layers.clear();
+    topology.clear();
+    for (auto& l : checkpoint.layers()) {
+        layers.emplace_back(l.in, l.out, l.activation, l.isOutput);
+        topology.push_back({ l.out, l.activation });
+    }
+    inputSize = layers[0].inSize;
+    setClasses(layers.back().outSize);
+    reserveBatch(batchSize);
+    for (int i = 0; i < (int)layers.size(); i++) {
+        cpu::DenseLayer& layer = layers[i];
+        const float* W = checkpoint.tensor(weightName(i), static_cast<size_t>(layer.outSize) * layer.inSize);
+        for (int r = 0; r < layer.outSize; r++) {
+            memcpy(layer.W.row(r), W + static_cast<size_t>(r) * layer.inSize, layer.inSize * sizeof(float));
+        }
+        memcpy(layer.b.data, checkpoint.tensor(biasName(i), layer.outSize), layer.outSize * sizeof(float));
+    }
+    zeroGrad();
+
+    // Version 1 files do not name their optimizer, so the current one takes whatever
+    // moments match its buffer names
+    if (state.hasOptimizer) {
+        optimizer = cpu::makeOptimizer(state.optimizer);
+    }
+    if (optimizer) {
+        optimizer->reset();
+        optimizer->reserve(layers);
+        for (auto& buffer : optimizer->state()) {
+            if (checkpoint.has(buffer.name)) {
+                const float* data = checkpoint.tensor(buffer.name, buffer.data.size());
+                std::copy(data, data + buffer.data.size(), buffer.data.begin());
+            }
+            else if (state.hasOptimizer) {
+                throw std::runtime_error("The checkpoint has no optimizer state " + buffer.name);
+            }
+        }
+        optimizer->setSteps(state.optimizerSteps);
+    }
+
+    telemetry.reset(trainSource ? trainSource->size() : 0, state.position);
+    publishedWeights.publish(layers, normalization, state.position);
+    std::lock_guard<std::mutex> guard(nnMutex);
+    status = NetworkStatus::paused;
+}
+
+
+// Evaluates the latest published weights, so it never reads the layers the trainer is
+// updating; it only queues behind a running background evaluation, which shares the
+// evaluator and the confusion matrix
+float Network::test(int n) {
+    std::lock_guard<std::mutex> guard(testMutex);
+    return evaluatePublished(n);
+}
+#endif // CUDA
+
+}
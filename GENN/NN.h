@@ -1,21 +1,49 @@
 #pragma once
 
+#include <future>
+#include <memory>
 #include <random>
 #include "Matrix.h"
 #include "Vector.h"
+#include "Arena.h"
+#include "ThreadPool.h"
+#include "Telemetry.h"
+#include "Checkpoint.h"
+#include "Evaluator.h"
+#include "InferenceModel.h"
+#include "QuantizedModel.h"
+#include "Dataset.h"
+#include "Loader.h"
+#include "Optimizer.h"
+#include "Profiler.h"
+#include "WeightSnapshot.h"
 
 
 namespace nn {
 
 
+#ifndef CUDA
+struct LayerSpec {
+    int outputs;
+    cpu::Activation activation;
+};
+
+// Comma-separated layer widths with optional activations, e.g. "128:relu,64:gelu,10".
+// Hidden layers default to sigmoid and the last layer, which produces the logits, to linear.
+std::vector<LayerSpec> parseTopology(const std::string& spec);
+
+
+struct Replica {
+    cpu::Arena arena;
+    std::vector<cpu::DenseLayer> layers;
+};
+#endif // !CUDA
+
+
 class Network {
 
     enum NetworkStatus { zero, training, paused };
 
-private:
-    std::vector<int> currentPredictions;
-    std::vector<float> loss;
-
 public:
     std::mutex nnMutex;
 
@@ -23,17 +51,39 @@ public:
 
     NetworkStatus status = NetworkStatus::zero;
     float learningRate = 0.01f;
+    int batchSize = 50;
+    int threads = 1;
+    unsigned int seed = std::random_device{}();
 
-    int epoch = 0;
+    // Input normalization; measured from the training images in setTrainData when set
+    Normalization normalization;
+    bool measureNormalization = false;
 
+    Telemetry telemetry;
+    // Per-layer phase timings of the training loop; records only in GENN_PROFILE builds
+    cpu::Profiler profiler;
+
+#ifdef CUDA
     std::vector<pf::Vector> images;
+#else
+    ImageSet images;
+#endif // CUDA
     std::vector<int> labels;
 
     std::vector<int> testOrder;
+#ifdef CUDA
+    std::mt19937 shuffleGen{ std::random_device{}() };
+#endif // CUDA
+#ifdef CUDA
     std::vector<pf::Vector> testImages;
+#else
+    ImageSet testImages;
+#endif // CUDA
     std::vector<int> testLabels;
 
-    cpu::Matrix confusionMatrix;
+    // Filled by test(); setClasses swaps in a new matrix, so other threads read it through
+    // testConfusion()
+    std::shared_ptr<ConfusionMatrix> confusion = std::make_shared<ConfusionMatrix>();
 
     Network();
 
@@ -44,11 +94,104 @@ public:
     void step();
     void zeroGrad();
 
-    void setPosition(int n);
+#ifndef CUDA
+    // Layers after the inputSize network inputs, the last one producing the class logits;
+    // initLayers builds from them and restore replaces them with the checkpoint's
+    int inputSize = 784;
+    std::vector<LayerSpec> topology = {
+        { 64, cpu::Activation::sigmoid },
+        { 64, cpu::Activation::sigmoid },
+        { 10, cpu::Activation::linear }
+    };
+
+    cpu::Arena arena;
+    cpu::MatrixView input;
+    std::unique_ptr<cpu::ThreadPool> pool;
+    std::shared_ptr<SampleSource> trainSource;
+    LoaderOptions loading;
+    std::unique_ptr<BatchLoader> loader;
+
+    void setTrainSource(std::shared_ptr<SampleSource> source);
+    std::vector<Replica> replicas;
+
+    // Sizes the confusion matrices to the last layer once the labels are known to fit
+    void setClasses(int classes);
+
+    void reserveBatch(int n);
+    void reserveWorkers(int n);
+    std::vector<cpu::DenseLayer>& shardLayers(int t);
+    void forwardBatch(int p, int n);
+    void backwardBatch(const int* labels);
+    void trainBatch(cpu::ConstMatrixView x, const int* labels);
+    void reduceGradients();
+
+    // Storage format of the weights the batched forward and backward products read. bf16 and
+    // fp16 keep a converted copy that is refreshed after every step; the optimizer, the
+    // gradients and the checkpoints keep using the fp32 master weights.
+    cpu::Precision precision = cpu::Precision::fp32;
+    cpu::Arena halfWeights;
+
+    void refreshHalfWeights();
+
+    // Plain SGD at learningRate unless set before training starts. learningRate is only read
+    // when that default is made; afterwards, and for any other optimizer, the rate is the
+    // optimizer's schedule, which checkpoints store.
+    std::unique_ptr<cpu::Optimizer> optimizer;
+    cpu::Optimizer& getOptimizer();
+
+    // The background evaluation; evaluationMutex guards the future, which the trainer
+    // replaces while other threads wait on it
+    std::future<float> evaluation;
+    std::mutex evaluationMutex;
+
+    // Versions of the weights for readers on other threads. The trainer publishes one every
+    // publishInterval optimizer steps and when it stops, and initLayers, restore and
+    // setTrainData publish while it is not running; test(), freeze() and quantize() read
+    // the latest, so they can run while training continues.
+    WeightPublisher publishedWeights;
+    int publishInterval = 10;
+    // One evaluator for test() and the background evaluation; testMutex guards it,
+    // confusion and, on the CPU, testImages and testLabels
+    std::unique_ptr<Evaluator> evaluator;
+    std::mutex testMutex;
+
+    void publishIfIdle();
+
+    float evaluatePublished(int n);
+    void startEvaluation(int n);
+    void waitEvaluation();
+
+    // Read-only copy of the latest published weights for serving
+    std::shared_ptr<const InferenceModel> freeze() const;
+    // Int8 copy calibrated on `samples` training images; compare its evaluate() with test()
+    std::shared_ptr<const QuantizedModel> quantize(int samples) const;
+
+    // Automatic checkpoints to checkpointPath every checkpointInterval samples; 0 disables
+    std::string checkpointPath;
+    long long checkpointInterval = 0;
+
+    // Snapshots the weights at the next batch boundary, or at once when the trainer is not
+    // running, and writes the file on a background thread
+    void saveCheckpoint(const std::string& filename);
+    void waitCheckpoint();
+    // Replaces topology, weights, optimizer and training state; resumeTraining() then
+    // continues the run from the stored position. Set the training data first. The
+    // checkpoint's optimizer replaces the current one, except for version 1 files, which
+    // restore into the optimizer already set.
+    void restore(const Checkpoint& checkpoint);
+
+    std::mutex checkpointMutex;
+    bool trainerRunning = false;
+    std::string checkpointRequest;
+    std::future<void> checkpointWrite;
+
+    void writeCheckpoint(const std::string& filename, long long position);
+#endif // !CUDA
+
     int getPosition();
+    int getEpoch();
 
     float meanLoss();
-    void setLoss(float loss);
     std::vector<float> getLoss();
 
     void startTraining();
@@ -58,16 +201,23 @@ public:
     bool isTraining();
     bool isPaused();
 
+#ifdef CUDA
     pf::Vector& getImage(int p);
+#endif // CUDA
     int getLabel(int p);
 
-    std::vector<int> getPredictions(int n);
+    std::vector<Prediction> getPredictions(int n);
 
+    void setTrainData(const ImageSet& images, const std::vector<int>& labels);
+    void setTestData(const ImageSet& images, const std::vector<int>& labels);
     void setTrainData(const std::vector<cpu::Matrix>& images, const std::vector<int>& labels);
     void setTestData(const std::vector<cpu::Matrix>& images, const std::vector<int>& labels);
 
     float trainPrecision();
     float testPrecision();
+    std::shared_ptr<const ConfusionMatrix> testConfusion() const;
+    // Width of the last layer; labels must lie below it
+    int classes() const;
 
     void train();
     int predict(int p);
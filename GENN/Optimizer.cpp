@@ -0,0 +1,329 @@
+#include "pch.h"
+#include "Optimizer.h"
+#include "Simd.h"
+
+
+namespace cpu {
+
+
+float LearningRateSchedule::at(long long t) const {
+    if (t < warmup)
+        return rate * static_cast<float>(t + 1) / static_cast<float>(warmup);
+    long long s = t - warmup;
+    switch (kind) {
+    case step:
+        return period > 0 ? rate * std::pow(gamma, static_cast<float>(s / period)) : rate;
+    case cosine:
+        if (period <= 0)
+            return rate;
+        return minimum + 0.5f * (rate - minimum) *
+            (1.0f + std::cos(3.14159265f * static_cast<float>(std::min(s, period)) / static_cast<float>(period)));
+    default:
+        return rate;
+    }
+}
+
+
+// v == nullptr is plain SGD. With momentum v = mu v + d, and the step is v, or d + mu v
+// for Nesterov, where d is the gradient plus weight decay.
+typedef void (*SgdKernel)(float* w, float* g, float* v, int n, float lr, float mu, float decay, bool nesterov);
+typedef void (*AdamKernel)(float* w, float* g, float* m, float* v, int n, float lr,
+    float b1, float b2, float eps, float c1, float c2, float decay, bool decoupled);
+
+
+static void sgdScalar(float* w, float* g, float* v, int n, float lr, float mu, float decay, bool nesterov) {
+    for (int i = 0; i < n; i++) {
+        float d = g[i] + decay * w[i];
+        if (v != nullptr) {
+            v[i] = mu * v[i] + d;
+            d = nesterov ? d + mu * v[i] : v[i];
+        }
+        w[i] -= lr * d;
+        g[i] = 0.0f;
+    }
+}
+
+
+// c1 and c2 are the bias corrections 1 / (1 - beta^t)
+static void adamScalar(float* w, float* g, float* m, float* v, int n, float lr,
+    float b1, float b2, float eps, float c1, float c2, float decay, bool decoupled) {
+    for (int i = 0; i < n; i++) {
+        float d = decoupled ? g[i] : g[i] + decay * w[i];
+        m[i] = b1 * m[i] + (1.0f - b1) * d;
+        v[i] = b2 * v[i] + (1.0f - b2) * d * d;
+        float u = m[i] * c1 / (std::sqrt(v[i] * c2) + eps);
+        w[i] -= lr * (decoupled ? u + decay * w[i] : u);
+        g[i] = 0.0f;
+    }
+}
+
+
+#if defined(GENN_X86)
+GENN_TARGET_AVX2 static void sgdAvx2(float* w, float* g, float* v, int n, float lr, float mu, float decay, bool nesterov) {
+    __m256 vlr = _mm256_set1_ps(lr);
+    __m256 vmu = _mm256_set1_ps(mu);
+    __m256 vdecay = _mm256_set1_ps(decay);
+    __m256 zero = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 wi = _mm256_loadu_ps(w + i);
+        __m256 d = _mm256_fmadd_ps(vdecay, wi, _mm256_loadu_ps(g + i));
+        if (v != nullptr) {
+            __m256 vi = _mm256_fmadd_ps(vmu, _mm256_loadu_ps(v + i), d);
+            _mm256_storeu_ps(v + i, vi);
+            d = nesterov ? _mm256_fmadd_ps(vmu, vi, d) : vi;
+        }
+        _mm256_storeu_ps(w + i, _mm256_fnmadd_ps(vlr, d, wi));
+        _mm256_storeu_ps(g + i, zero);
+    }
+    sgdScalar(w + i, g + i, v == nullptr ? nullptr : v + i, n - i, lr, mu, decay, nesterov);
+}
+
+
+GENN_TARGET_AVX2 static void adamAvx2(float* w, float* g, float* m, float* v, int n, float lr,
+    float b1, float b2, float eps, float c1, float c2, float decay, bool decoupled) {
+    __m256 vlr = _mm256_set1_ps(lr);
+    __m256 vb1 = _mm256_set1_ps(b1);
+    __m256 vb2 = _mm256_set1_ps(b2);
+    __m256 va1 = _mm256_set1_ps(1.0f - b1);
+    __m256 va2 = _mm256_set1_ps(1.0f - b2);
+    __m256 veps = _mm256_set1_ps(eps);
+    __m256 vc1 = _mm256_set1_ps(c1);
+    __m256 vc2 = _mm256_set1_ps(c2);
+    __m256 vdecay = _mm256_set1_ps(decay);
+    __m256 zero = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 wi = _mm256_loadu_ps(w + i);
+        __m256 d = _mm256_loadu_ps(g + i);
+        if (!decoupled) {
+            d = _mm256_fmadd_ps(vdecay, wi, d);
+        }
+        __m256 mi = _mm256_fmadd_ps(vb1, _mm256_loadu_ps(m + i), _mm256_mul_ps(va1, d));
+        __m256 vi = _mm256_fmadd_ps(vb2, _mm256_loadu_ps(v + i), _mm256_mul_ps(va2, _mm256_mul_ps(d, d)));
+        _mm256_storeu_ps(m + i, mi);
+        _mm256_storeu_ps(v + i, vi);
+        __m256 u = _mm256_div_ps(_mm256_mul_ps(mi, vc1), _mm256_add_ps(_mm256_sqrt_ps(_mm256_mul_ps(vi, vc2)), veps));
+        if (decoupled) {
+            u = _mm256_fmadd_ps(vdecay, wi, u);
+        }
+        _mm256_storeu_ps(w + i, _mm256_fnmadd_ps(vlr, u, wi));
+        _mm256_storeu_ps(g + i, zero);
+    }
+    adamScalar(w + i, g + i, m + i, v + i, n - i, lr, b1, b2, eps, c1, c2, decay, decoupled);
+}
+
+
+GENN_TARGET_AVX512 static void sgdAvx512(float* w, float* g, float* v, int n, float lr, float mu, float decay, bool nesterov) {
+    __m512 vlr = _mm512_set1_ps(lr);
+    __m512 vmu = _mm512_set1_ps(mu);
+    __m512 vdecay = _mm512_set1_ps(decay);
+    __m512 zero = _mm512_setzero_ps();
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512 wi = _mm512_loadu_ps(w + i);
+        __m512 d = _mm512_fmadd_ps(vdecay, wi, _mm512_loadu_ps(g + i));
+        if (v != nullptr) {
+            __m512 vi = _mm512_fmadd_ps(vmu, _mm512_loadu_ps(v + i), d);
+            _mm512_storeu_ps(v + i, vi);
+            d = nesterov ? _mm512_fmadd_ps(vmu, vi, d) : vi;
+        }
+        _mm512_storeu_ps(w + i, _mm512_fnmadd_ps(vlr, d, wi));
+        _mm512_storeu_ps(g + i, zero);
+    }
+    sgdScalar(w + i, g + i, v == nullptr ? nullptr : v + i, n - i, lr, mu, decay, nesterov);
+}
+
+
+GENN_TARGET_AVX512 static void adamAvx512(float* w, float* g, float* m, float* v, int n, float lr,
+    float b1, float b2, float eps, float c1, float c2, float decay, bool decoupled) {
+    __m512 vlr = _mm512_set1_ps(lr);
+    __m512 vb1 = _mm512_set1_ps(b1);
+    __m512 vb2 = _mm512_set1_ps(b2);
+    __m512 va1 = _mm512_set1_ps(1.0f - b1);
+    __m512 va2 = _mm512_set1_ps(1.0f - b2);
+    __m512 veps = _mm512_set1_ps(eps);
+    __m512 vc1 = _mm512_set1_ps(c1);
+    __m512 vc2 = _mm512_set1_ps(c2);
+    __m512 vdecay = _mm512_set1_ps(decay);
+    __m512 zero = _mm512_setzero_ps();
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512 wi = _mm512_loadu_ps(w + i);
+        __m512 d = _mm512_loadu_ps(g + i);
+        if (!decoupled) {
+            d = _mm512_fmadd_ps(vdecay, wi, d);
+        }
+        __m512 mi = _mm512_fmadd_ps(vb1, _mm512_loadu_ps(m + i), _mm512_mul_ps(va1, d));
+        __m512 vi = _mm512_fmadd_ps(vb2, _mm512_loadu_ps(v + i), _mm512_mul_ps(va2, _mm512_mul_ps(d, d)));
+        _mm512_storeu_ps(m + i, mi);
+        _mm512_storeu_ps(v + i, vi);
+        __m512 u = _mm512_div_ps(_mm512_mul_ps(mi, vc1), _mm512_add_ps(_mm512_sqrt_ps(_mm512_mul_ps(vi, vc2)), veps));
+        if (decoupled) {
+            u = _mm512_fmadd_ps(vdecay, wi, u);
+        }
+        _mm512_storeu_ps(w + i, _mm512_fnmadd_ps(vlr, u, wi));
+        _mm512_storeu_ps(g + i, zero);
+    }
+    adamScalar(w + i, g + i, m + i, v + i, n - i, lr, b1, b2, eps, c1, c2, decay, decoupled);
+}
+#endif
+
+
+static SgdKernel selectSgd() {
+#if defined(GENN_X86)
+    switch (simd::level()) {
+    case simd::avx512:
+        return sgdAvx512;
+    case simd::avx2:
+        return sgdAvx2;
+    default:
+        break;
+    }
+#endif
+    return sgdScalar;
+}
+
+
+static AdamKernel selectAdam() {
+#if defined(GENN_X86)
+    switch (simd::level()) {
+    case simd::avx512:
+        return adamAvx512;
+    case simd::avx2:
+        return adamAvx2;
+    default:
+        break;
+    }
+#endif
+    return adamScalar;
+}
+
+
+Optimizer::Optimizer(const std::string& name, int moments, const LearningRateSchedule& schedule) :
+    schedule(schedule), name(name), moments(moments) {
+}
+
+
+void Optimizer::reserve(const std::vector<DenseLayer>& layers) {
+    size_t count = 2 * layers.size() * moments;
+    bool fits = buffers.size() == count;
+    for (size_t l = 0; fits && l < layers.size(); l++) {
+        for (int j = 0; j < moments; j++) {
+            fits = fits &&
+                buffers[(2 * l) * moments + j].data.size() == static_cast<size_t>(layers[l].outSize) * layers[l].inSize &&
+                buffers[(2 * l + 1) * moments + j].data.size() == static_cast<size_t>(layers[l].outSize);
+        }
+    }
+    if (fits)
+        return;
+
+    buffers.clear();
+    for (size_t l = 0; l < layers.size(); l++) {
+        for (int k = 0; k < 2; k++) {
+            std::string tensor = "layer" + std::to_string(l) + (k == 0 ? ".W" : ".b");
+            size_t n = k == 0 ? static_cast<size_t>(layers[l].outSize) * layers[l].inSize : layers[l].outSize;
+            for (int j = 0; j < moments; j++) {
+                buffers.push_back({ name + "." + std::to_string(j) + "." + tensor, std::vector<float>(n, 0.0f) });
+            }
+        }
+    }
+}
+
+
+void Optimizer::step(std::vector<DenseLayer>& layers) {
+    reserve(layers);
+    float lr = schedule.at(t);
+    ++t;
+    std::vector<float*> m(std::max(1, moments));
+    for (size_t l = 0; l < layers.size(); l++) {
+        DenseLayer& layer = layers[l];
+        if (!layer.W.contiguous() || !layer.gradW.contiguous())
+            throw std::runtime_error("Optimizer needs contiguous parameters");
+#ifdef GENN_PROFILE
+        // Nominally one multiply-add per parameter; reads and writes W, the gradient and the moments
+        long long parameters = static_cast<long long>(layer.outSize) * (layer.inSize + 1);
+        GENN_PROFILE_SCOPE(profiler, Phase::step, static_cast<int>(l), 2 * parameters, parameters * sizeof(float) * (4 + 2 * moments));
+#endif // GENN_PROFILE
+        for (int j = 0; j < moments; j++) {
+            m[j] = buffers[(2 * l) * moments + j].data.data();
+        }
+        update(layer.W.data, layer.gradW.data, m.data(), layer.outSize * layer.inSize, lr, weightDecay);
+        for (int j = 0; j < moments; j++) {
+            m[j] = buffers[(2 * l + 1) * moments + j].data.data();
+        }
+        update(layer.b.data, layer.gradb.data, m.data(), layer.outSize, lr, 0.0f);
+    }
+}
+
+
+void Optimizer::reset() {
+    t = 0;
+    buffers.clear();
+}
+
+
+Sgd::Sgd(const LearningRateSchedule& schedule, float momentum, bool nesterov) :
+    Optimizer("sgd", momentum != 0.0f ? 1 : 0, schedule), momentum(momentum), nesterov(nesterov) {
+}
+
+
+OptimizerConfig Sgd::config() const {
+    OptimizerConfig c;
+    c.kind = OptimizerConfig::sgd;
+    c.schedule = schedule;
+    c.weightDecay = weightDecay;
+    c.momentum = momentum;
+    c.nesterov = nesterov;
+    return c;
+}
+
+
+void Sgd::update(float* w, float* g, float* const* m, int n, float lr, float decay) {
+    selectSgd()(w, g, momentum != 0.0f ? m[0] : nullptr, n, lr, momentum, decay, nesterov);
+}
+
+
+Adam::Adam(const LearningRateSchedule& schedule, bool decoupled) :
+    Optimizer(decoupled ? "adamw" : "adam", 2, schedule), decoupled(decoupled) {
+}
+
+
+OptimizerConfig Adam::config() const {
+    OptimizerConfig c;
+    c.kind = OptimizerConfig::adam;
+    c.schedule = schedule;
+    c.weightDecay = weightDecay;
+    c.decoupled = decoupled;
+    c.beta1 = beta1;
+    c.beta2 = beta2;
+    c.epsilon = epsilon;
+    return c;
+}
+
+
+void Adam::update(float* w, float* g, float* const* m, int n, float lr, float decay) {
+    float c1 = 1.0f / (1.0f - std::pow(beta1, static_cast<float>(t)));
+    float c2 = 1.0f / (1.0f - std::pow(beta2, static_cast<float>(t)));
+    selectAdam()(w, g, m[0], m[1], n, lr, beta1, beta2, epsilon, c1, c2, decay, decoupled);
+}
+
+
+std::unique_ptr<Optimizer> makeOptimizer(const OptimizerConfig& config) {
+    std::unique_ptr<Optimizer> o;
+    if (config.kind == OptimizerConfig::adam) {
+        Adam* adam = new Adam(config.schedule, config.decoupled);
+        adam->beta1 = config.beta1;
+        adam->beta2 = config.beta2;
+        adam->epsilon = config.epsilon;
+        o.reset(adam);
+    }
+    else {
+        o.reset(new Sgd(config.schedule, config.momentum, config.nesterov));
+    }
+    o->weightDecay = config.weightDecay;
+    return o;
+}
+
+
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "DenseLayer.h"
+#include "Profiler.h"
+
+
+namespace cpu {
+
+
+// Learning rate as a function of the optimizer step: linear warmup over the first warmup
+// steps, then constant, multiplied by gamma every period steps, or cosine-annealed from
+// rate down to minimum over period steps
+struct LearningRateSchedule {
+    enum Kind { constant, step, cosine };
+
+    Kind kind = constant;
+    float rate = 0.01f;
+    long long warmup = 0;
+    long long period = 0;
+    float gamma = 0.1f;
+    float minimum = 0.0f;
+
+    LearningRateSchedule() = default;
+    LearningRateSchedule(float rate) : rate(rate) {}
+
+    float at(long long t) const;
+};
+
+
+// Which optimizer and its settings, enough to rebuild it, e.g. from a checkpoint
+struct OptimizerConfig {
+    enum Kind { sgd, adam };
+
+    Kind kind = sgd;
+    LearningRateSchedule schedule;
+    float weightDecay = 0.0f;
+    // Sgd
+    float momentum = 0.0f;
+    bool nesterov = false;
+    // Adam; decoupled selects AdamW
+    bool decoupled = false;
+    float beta1 = 0.9f;
+    float beta2 = 0.999f;
+    float epsilon = 1e-8f;
+};
+
+
+// Updates every layer's W and b from its accumulated gradients. Each update is one fused
+// pass per tensor that reads the gradient once, updates the moment buffers, writes the
+// parameters and zeroes the gradient, so no separate zeroGrad() pass is needed. Weight
+// decay applies to W only.
+class Optimizer {
+public:
+    struct Buffer {
+        std::string name;
+        std::vector<float> data;
+    };
+
+    LearningRateSchedule schedule;
+    float weightDecay = 0.0f;
+    // Receives one step entry per layer when profiling is compiled in
+    Profiler* profiler = nullptr;
+
+    Optimizer(const std::string& name, int moments, const LearningRateSchedule& schedule);
+    virtual ~Optimizer() = default;
+
+    long long steps() const { return t; }
+    void setSteps(long long steps) { t = steps; }
+    float rate() const { return schedule.at(t); }
+    virtual OptimizerConfig config() const = 0;
+
+    void step(std::vector<DenseLayer>& layers);
+    // Forgets the moments and restarts the schedule, e.g. for freshly initialized weights
+    void reset();
+
+    // Zero-filled moment buffers for these layers, named "<optimizer>.<moment>.<tensor>"
+    // so that checkpoints can store and restore them
+    void reserve(const std::vector<DenseLayer>& layers);
+    std::vector<Buffer>& state() { return buffers; }
+
+protected:
+    // m holds the moment buffers of this tensor; t is already the 1-based step number
+    virtual void update(float* w, float* g, float* const* m, int n, float lr, float decay) = 0;
+
+    long long t = 0;
+
+private:
+    std::string name;
+    int moments;
+    std::vector<Buffer> buffers;
+};
+
+
+// SGD with optional heavy-ball or Nesterov momentum; weight decay is added to the gradient
+class Sgd : public Optimizer {
+public:
+    Sgd(const LearningRateSchedule& schedule, float momentum = 0.0f, bool nesterov = false);
+
+    OptimizerConfig config() const override;
+
+protected:
+    void update(float* w, float* g, float* const* m, int n, float lr, float decay) override;
+
+private:
+    float momentum;
+    bool nesterov;
+};
+
+
+// Adam with bias correction; decoupled selects AdamW, which decays the weights directly
+// instead of adding the decay to the gradient
+class Adam : public Optimizer {
+public:
+    float beta1 = 0.9f;
+    float beta2 = 0.999f;
+    float epsilon = 1e-8f;
+
+    Adam(const LearningRateSchedule& schedule, bool decoupled = false);
+
+    OptimizerConfig config() const override;
+
+protected:
+    void update(float* w, float* g, float* const* m, int n, float lr, float decay) override;
+
+private:
+    bool decoupled;
+};
+
+
+std::unique_ptr<Optimizer> makeOptimizer(const OptimizerConfig& config);
+
+
+}
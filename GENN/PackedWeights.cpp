@@ -0,0 +1,47 @@
+#include "pch.h"
+#include "PackedWeights.h"
+
+
+namespace nn {
+
+
+void PackedWeights::assign(const std::vector<cpu::DenseLayer>& layers) {
+    size_t size = 0;
+    widest = 0;
+    for (size_t i = 0; i < layers.size(); i++) {
+        if (i > 0 && layers[i].inSize != layers[i - 1].outSize)
+            throw std::runtime_error("Layer " + std::to_string(i) + " expects " + std::to_string(layers[i].inSize) +
+                " inputs but receives " + std::to_string(layers[i - 1].outSize));
+        size += cpu::Arena::padded(layers[i].outSize * layers[i].inSize) + cpu::Arena::padded(layers[i].outSize);
+        widest = std::max(widest, layers[i].outSize);
+    }
+    if (storage.capacity() < size)
+        storage = cpu::Arena(size);
+    storage.reset();
+
+    packed.clear();
+    for (auto& layer : layers) {
+        float* W = storage.allocate(layer.outSize * layer.inSize);
+        float* b = storage.allocate(layer.outSize);
+        for (int i = 0; i < layer.outSize; i++) {
+            memcpy(W + i * layer.inSize, layer.W.row(i), layer.inSize * sizeof(float));
+        }
+        memcpy(b, layer.b.data, layer.outSize * sizeof(float));
+        packed.push_back({ cpu::ConstMatrixView(W, layer.outSize, layer.inSize), b, layer.activation, layer.isOutput });
+    }
+}
+
+
+std::vector<cpu::DenseLayer> PackedWeights::views() const {
+    std::vector<cpu::DenseLayer> r;
+    for (auto& layer : packed) {
+        cpu::DenseLayer view(layer.W.w, layer.W.h, layer.activation, layer.isOutput);
+        view.W = cpu::MatrixView(const_cast<float*>(layer.W.data), layer.W.h, layer.W.w);
+        view.b = cpu::VectorView(const_cast<float*>(layer.b), layer.W.h);
+        r.push_back(view);
+    }
+    return r;
+}
+
+
+}
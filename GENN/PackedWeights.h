@@ -0,0 +1,49 @@
+#pragma once
+
+#include <vector>
+#include "Activation.h"
+#include "Arena.h"
+#include "DenseLayer.h"
+#include "Matrix.h"
+
+
+namespace nn {
+
+
+// Read-only copy of a layer stack's weights and biases in one aligned block, each W
+// row-major out x in; what the evaluator, the inference model and the published weight
+// snapshots keep instead of the training layers.
+class PackedWeights {
+public:
+    struct Layer {
+        cpu::ConstMatrixView W;
+        const float* b;
+        cpu::Activation activation;
+        bool isOutput;
+    };
+
+    PackedWeights() = default;
+    explicit PackedWeights(const std::vector<cpu::DenseLayer>& layers) { assign(layers); }
+
+    // Copies the layers, reusing the block when it is large enough
+    void assign(const std::vector<cpu::DenseLayer>& layers);
+
+    const std::vector<Layer>& layers() const { return packed; }
+    bool empty() const { return packed.empty(); }
+    int inputSize() const { return packed.front().W.w; }
+    int classes() const { return packed.back().W.h; }
+    // Outputs of the widest layer
+    int width() const { return widest; }
+
+    // DenseLayers whose W and b view the block, for the code that takes training layers;
+    // they must only be read
+    std::vector<cpu::DenseLayer> views() const;
+
+private:
+    cpu::Arena storage;
+    std::vector<Layer> packed;
+    int widest = 0;
+};
+
+
+}
@@ -0,0 +1,172 @@
+#include "pch.h"
+#include "Profiler.h"
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+
+namespace cpu {
+
+
+static const char* PHASE_NAMES[] = { "forward", "backward", "step", "zeroGrad", "reduce", "load", "lockWait" };
+
+
+const char* phaseName(Phase phase) {
+    return PHASE_NAMES[static_cast<int>(phase)];
+}
+
+
+double ProfileEntry::percentile(double q) const {
+    long long target = static_cast<long long>(std::ceil(q * calls));
+    long long seen = 0;
+    for (int i = 0; i < (int)histogram.size(); i++) {
+        seen += histogram[i];
+        if (seen >= target && seen > 0)
+            return std::ldexp(1.5, i) * 1e-9;
+    }
+    return 0.0;
+}
+
+
+static int bucket(long long ns) {
+    int b = 0;
+    for (unsigned long long v = static_cast<unsigned long long>(ns) >> 1; v != 0 && b < Profiler::BUCKETS - 1; v >>= 1) {
+        b++;
+    }
+    return b;
+}
+
+
+// Small dense ids for the trace's thread rows
+static int threadId() {
+    static std::atomic<int> next{ 0 };
+    thread_local int id = next++;
+    return id;
+}
+
+
+Profiler::Profiler() : counters(new Counter[(MAX_LAYERS + 1) * PHASES]) {
+    reset();
+}
+
+
+bool Profiler::compiledIn() {
+#ifdef GENN_PROFILE
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+long long Profiler::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+void Profiler::record(Phase phase, int layer, long long start, long long end, long long flops, long long bytes) {
+    if (layer >= MAX_LAYERS)
+        return;
+    long long ns = end - start;
+    Counter& c = counters[(layer < 0 ? MAX_LAYERS : layer) * PHASES + static_cast<int>(phase)];
+    c.calls.fetch_add(1, std::memory_order_relaxed);
+    c.ns.fetch_add(ns, std::memory_order_relaxed);
+    c.flops.fetch_add(flops, std::memory_order_relaxed);
+    c.bytes.fetch_add(bytes, std::memory_order_relaxed);
+    c.histogram[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+
+    if (tracing.load(std::memory_order_relaxed)) {
+        long long i = traced.fetch_add(1, std::memory_order_relaxed);
+        TraceEvent& e = events[static_cast<size_t>(i % (long long)events.size())];
+        e.start = start;
+        e.duration = ns;
+        e.phase = static_cast<short>(phase);
+        e.layer = static_cast<short>(layer);
+        e.thread = threadId();
+    }
+}
+
+
+void Profiler::reset() {
+    for (int i = 0; i < (MAX_LAYERS + 1) * PHASES; i++) {
+        Counter& c = counters[i];
+        c.calls.store(0, std::memory_order_relaxed);
+        c.ns.store(0, std::memory_order_relaxed);
+        c.flops.store(0, std::memory_order_relaxed);
+        c.bytes.store(0, std::memory_order_relaxed);
+        for (auto& h : c.histogram) {
+            h.store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+
+std::vector<ProfileEntry> Profiler::snapshot() const {
+    std::vector<ProfileEntry> entries;
+    for (int l = -1; l < MAX_LAYERS; l++) {
+        for (int p = 0; p < PHASES; p++) {
+            const Counter& c = counters[(l < 0 ? MAX_LAYERS : l) * PHASES + p];
+            long long calls = c.calls.load(std::memory_order_relaxed);
+            if (calls == 0)
+                continue;
+            ProfileEntry e;
+            e.layer = l;
+            e.phase = static_cast<Phase>(p);
+            e.calls = calls;
+            e.seconds = c.ns.load(std::memory_order_relaxed) * 1e-9;
+            e.flops = static_cast<double>(c.flops.load(std::memory_order_relaxed));
+            e.bytes = static_cast<double>(c.bytes.load(std::memory_order_relaxed));
+            for (auto& h : c.histogram) {
+                e.histogram.push_back(h.load(std::memory_order_relaxed));
+            }
+            entries.push_back(e);
+        }
+    }
+    return entries;
+}
+
+
+void Profiler::startTrace(size_t capacity) {
+    tracing = false;
+    events.assign(std::max<size_t>(1, capacity), TraceEvent());
+    traced = 0;
+    origin = now();
+    tracing = true;
+}
+
+
+void Profiler::stopTrace() {
+    tracing = false;
+}
+
+
+std::string Profiler::chromeTrace() const {
+    long long n = traced.load();
+    long long size = static_cast<long long>(events.size());
+    long long first = std::max(0LL, n - size);
+
+    std::ostringstream out;
+    out << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n";
+    char line[256];
+    for (long long i = first; i < n; i++) {
+        const TraceEvent& e = events[static_cast<size_t>(i % size)];
+        std::string name = e.layer < 0 ? phaseName(static_cast<Phase>(e.phase)) :
+            std::string(phaseName(static_cast<Phase>(e.phase))) + " layer" + std::to_string(e.layer);
+        snprintf(line, sizeof(line), "{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": 1, \"tid\": %d}%s\n",
+            name.c_str(), e.layer < 0 ? "network" : "layer", (e.start - origin) * 1e-3, e.duration * 1e-3, e.thread, i + 1 < n ? "," : "");
+        out << line;
+    }
+    out << "]}\n";
+    return out.str();
+}
+
+
+void Profiler::writeChromeTrace(const std::string& filename) const {
+    std::ofstream out(filename);
+    out << chromeTrace();
+    if (!out)
+        throw std::runtime_error("Cannot write " + filename);
+}
+
+
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+namespace cpu {
+
+
+enum class Phase { forward, backward, step, zeroGrad, reduce, load, lockWait };
+
+
+// Totals of one (layer, phase) pair; layer is -1 for network-wide phases such as data
+// loading and lock waits
+struct ProfileEntry {
+    int layer = -1;
+    Phase phase = Phase::forward;
+    long long calls = 0;
+    double seconds = 0.0;
+    double flops = 0.0;
+    double bytes = 0.0;
+    // Calls per duration bucket; bucket i holds durations in [2^i, 2^(i+1)) nanoseconds
+    std::vector<long long> histogram;
+
+    double gflops() const { return seconds > 0 ? flops / seconds * 1e-9 : 0.0; }
+    double gbps() const { return seconds > 0 ? bytes / seconds * 1e-9 : 0.0; }
+    // Approximate duration in seconds below which a fraction q of the calls finished
+    double percentile(double q) const;
+};
+
+
+const char* phaseName(Phase phase);
+
+
+// Hot-path timers and FLOP/byte counters, aggregated per layer and phase into totals and
+// log2 histograms with relaxed atomics, so any number of threads can record at once.
+// Tracing additionally keeps the latest events in a ring for a Chrome trace export.
+// Recording only happens through GENN_PROFILE_SCOPE, which compiles to nothing unless
+// GENN_PROFILE is defined.
+class Profiler {
+public:
+    static const int MAX_LAYERS = 32;
+    static const int BUCKETS = 40;
+
+    Profiler();
+    Profiler(const Profiler&) = delete;
+    Profiler& operator= (const Profiler&) = delete;
+
+    static bool compiledIn();
+    // Steady clock in nanoseconds
+    static long long now();
+
+    void record(Phase phase, int layer, long long start, long long end, long long flops, long long bytes);
+
+    void reset();
+    // Entries with at least one call, by layer and then phase
+    std::vector<ProfileEntry> snapshot() const;
+
+    // Keeps the latest `capacity` events from now on. Start, stop and export the trace
+    // while nothing records, e.g. with training paused.
+    void startTrace(size_t capacity = 1 << 16);
+    void stopTrace();
+    // Chrome trace event format, viewable in chrome://tracing or Perfetto
+    std::string chromeTrace() const;
+    void writeChromeTrace(const std::string& filename) const;
+
+private:
+    static const int PHASES = 7;
+
+    struct Counter {
+        std::atomic<long long> calls;
+        std::atomic<long long> ns;
+        std::atomic<long long> flops;
+        std::atomic<long long> bytes;
+        std::atomic<long long> histogram[BUCKETS];
+    };
+
+    struct TraceEvent {
+        long long start;
+        long long duration;
+        short phase;
+        short layer;
+        int thread;
+    };
+
+    std::unique_ptr<Counter[]> counters;
+    std::vector<TraceEvent> events;
+    std::atomic<bool> tracing{ false };
+    std::atomic<long long> traced{ 0 };
+    long long origin = 0;
+};
+
+
+// Records the enclosing scope into a profiler; a null profiler records nothing
+class ProfileScope {
+public:
+    ProfileScope(Profiler* profiler, Phase phase, int layer, long long flops = 0, long long bytes = 0) :
+        profiler(profiler), phase(phase), layer(layer), flops(flops), bytes(bytes),
+        start(profiler != nullptr ? Profiler::now() : 0) {}
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator= (const ProfileScope&) = delete;
+
+    ~ProfileScope() {
+        if (profiler != nullptr) {
+            profiler->record(phase, layer, start, Profiler::now(), flops, bytes);
+        }
+    }
+
+private:
+    Profiler* profiler;
+    Phase phase;
+    int layer;
+    long long flops;
+    long long bytes;
+    long long start;
+};
+
+
+}
+
+
+// GENN_PROFILE_SCOPE(profiler, phase, layer[, flops, bytes]) times the rest of the block;
+// without GENN_PROFILE the arguments are not even evaluated
+#ifdef GENN_PROFILE
+#define GENN_PROFILE_SCOPE(...) cpu::ProfileScope gennProfileScope(__VA_ARGS__)
+#else
+#define GENN_PROFILE_SCOPE(...)
+#endif
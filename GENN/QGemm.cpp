@@ -0,0 +1,140 @@
+#include "pch.h"
+#include "QGemm.h"
+#include "Simd.h"
+
+
+namespace cpu {
+
+
+// Dot products of one row of A with rows j0..j0+n-1 of B, n <= 4
+typedef void (*DotKernel)(int K, const uint8_t* a, const int8_t* B, int ldb, int n, int32_t* c);
+
+
+static int32_t dotScalar(int K, const uint8_t* a, const int8_t* b) {
+    int32_t s = 0;
+    for (int k = 0; k < K; k++) {
+        s += static_cast<int32_t>(a[k]) * b[k];
+    }
+    return s;
+}
+
+
+static void kernelScalar(int K, const uint8_t* a, const int8_t* B, int ldb, int n, int32_t* c) {
+    for (int j = 0; j < n; j++) {
+        c[j] = dotScalar(K, a, B + j * ldb);
+    }
+}
+
+
+#if defined(GENN_X86)
+// Horizontal sums of four vectors at once, returned as the four lanes of one register
+GENN_TARGET_AVX2 static inline __m128i hsum4(__m256i s0, __m256i s1, __m256i s2, __m256i s3) {
+    __m256i t0 = _mm256_add_epi32(_mm256_unpacklo_epi32(s0, s1), _mm256_unpackhi_epi32(s0, s1));
+    __m256i t1 = _mm256_add_epi32(_mm256_unpacklo_epi32(s2, s3), _mm256_unpackhi_epi32(s2, s3));
+    __m256i u = _mm256_add_epi32(_mm256_unpacklo_epi64(t0, t1), _mm256_unpackhi_epi64(t0, t1));
+    return _mm_add_epi32(_mm256_castsi256_si128(u), _mm256_extracti128_si256(u, 1));
+}
+
+
+// maddubs multiplies u8 by s8 and adds adjacent pairs into s16, madd with ones widens to s32
+GENN_TARGET_AVX2 static inline __m256i dot32(__m256i a, const int8_t* b, __m256i ones, __m256i s) {
+    __m256i p = _mm256_maddubs_epi16(a, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b)));
+    return _mm256_add_epi32(s, _mm256_madd_epi16(p, ones));
+}
+
+
+GENN_TARGET_AVX2 static void kernelAvx2(int K, const uint8_t* a, const int8_t* B, int ldb, int n, int32_t* c) {
+    if (n < 4) {
+        kernelScalar(K, a, B, ldb, n, c);
+        return;
+    }
+    const int8_t* b0 = B;
+    const int8_t* b1 = b0 + ldb;
+    const int8_t* b2 = b1 + ldb;
+    const int8_t* b3 = b2 + ldb;
+    __m256i ones = _mm256_set1_epi16(1);
+    __m256i s0 = _mm256_setzero_si256();
+    __m256i s1 = _mm256_setzero_si256();
+    __m256i s2 = _mm256_setzero_si256();
+    __m256i s3 = _mm256_setzero_si256();
+    int k = 0;
+    for (; k + 32 <= K; k += 32) {
+        __m256i av = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + k));
+        s0 = dot32(av, b0 + k, ones, s0);
+        s1 = dot32(av, b1 + k, ones, s1);
+        s2 = dot32(av, b2 + k, ones, s2);
+        s3 = dot32(av, b3 + k, ones, s3);
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(c), hsum4(s0, s1, s2, s3));
+    if (k < K) {
+        c[0] += dotScalar(K - k, a + k, b0 + k);
+        c[1] += dotScalar(K - k, a + k, b1 + k);
+        c[2] += dotScalar(K - k, a + k, b2 + k);
+        c[3] += dotScalar(K - k, a + k, b3 + k);
+    }
+}
+
+
+GENN_TARGET_VNNI static inline __m256i fold(__m512i s) {
+    return _mm256_add_epi32(_mm512_castsi512_si256(s), _mm512_extracti64x4_epi64(s, 1));
+}
+
+
+// dpbusd does the u8 x s8 products and the 4-way sum into s32 in one instruction;
+// the tail uses masked loads, the zeroed bytes contribute nothing
+GENN_TARGET_VNNI static void kernelVnni(int K, const uint8_t* a, const int8_t* B, int ldb, int n, int32_t* c) {
+    if (n < 4) {
+        kernelScalar(K, a, B, ldb, n, c);
+        return;
+    }
+    const int8_t* b0 = B;
+    const int8_t* b1 = b0 + ldb;
+    const int8_t* b2 = b1 + ldb;
+    const int8_t* b3 = b2 + ldb;
+    __m512i s0 = _mm512_setzero_si512();
+    __m512i s1 = _mm512_setzero_si512();
+    __m512i s2 = _mm512_setzero_si512();
+    __m512i s3 = _mm512_setzero_si512();
+    int k = 0;
+    for (; k + 64 <= K; k += 64) {
+        __m512i av = _mm512_loadu_si512(a + k);
+        s0 = _mm512_dpbusd_epi32(s0, av, _mm512_loadu_si512(b0 + k));
+        s1 = _mm512_dpbusd_epi32(s1, av, _mm512_loadu_si512(b1 + k));
+        s2 = _mm512_dpbusd_epi32(s2, av, _mm512_loadu_si512(b2 + k));
+        s3 = _mm512_dpbusd_epi32(s3, av, _mm512_loadu_si512(b3 + k));
+    }
+    if (k < K) {
+        __mmask64 m = (1ULL << (K - k)) - 1;
+        __m512i av = _mm512_maskz_loadu_epi8(m, a + k);
+        s0 = _mm512_dpbusd_epi32(s0, av, _mm512_maskz_loadu_epi8(m, b0 + k));
+        s1 = _mm512_dpbusd_epi32(s1, av, _mm512_maskz_loadu_epi8(m, b1 + k));
+        s2 = _mm512_dpbusd_epi32(s2, av, _mm512_maskz_loadu_epi8(m, b2 + k));
+        s3 = _mm512_dpbusd_epi32(s3, av, _mm512_maskz_loadu_epi8(m, b3 + k));
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(c), hsum4(fold(s0), fold(s1), fold(s2), fold(s3)));
+}
+#endif
+
+
+static DotKernel selectKernel() {
+#if defined(GENN_X86)
+    if (simd::vnni())
+        return kernelVnni;
+    if (simd::level() >= simd::avx2)
+        return kernelAvx2;
+#endif
+    return kernelScalar;
+}
+
+
+void qgemm(int M, int N, int K, const uint8_t* A, int lda, const int8_t* B, int ldb, int32_t* C, int ldc) {
+    DotKernel kernel = selectKernel();
+    for (int i = 0; i < M; i++) {
+        for (int j = 0; j < N; j += 4) {
+            kernel(K, A + i * lda, B + j * ldb, ldb, std::min(4, N - j), C + i * ldc + j);
+        }
+    }
+}
+
+
+}
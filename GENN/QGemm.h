@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstdint>
+
+
+namespace cpu {
+
+
+// Largest quantized weight magnitude. Weights use 7 bits so that a pair of u8 x s8
+// products, 2 * 255 * 63, never saturates the 16-bit sums of AVX2 maddubs and every
+// kernel returns the same exact int32 result.
+const int QWEIGHT_MAX = 63;
+
+// Row-major int32 C (M x N) = A * B^T, where A is M x K uint8 and B is N x K int8
+// with entries in [-QWEIGHT_MAX, QWEIGHT_MAX]; M == 1 is the matrix-vector product
+void qgemm(int M, int N, int K, const uint8_t* A, int lda, const int8_t* B, int ldb, int32_t* C, int ldc);
+
+
+}
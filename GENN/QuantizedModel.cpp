@@ -0,0 +1,201 @@
+#include "pch.h"
+#include "QuantizedModel.h"
+#include "Gemm.h"
+#include "QGemm.h"
+
+
+namespace nn {
+
+
+const int QuantizedModel::chunk;
+
+
+// Scale and zero point mapping [lo, hi], widened to include 0, onto 0..255
+static void activationRange(float lo, float hi, float& scale, float& zero) {
+    lo = std::min(lo, 0.0f);
+    hi = std::max(hi, 0.0f);
+    scale = hi > lo ? (hi - lo) / 255.0f : 1.0f;
+    zero = std::round(-lo / scale);
+}
+
+
+QuantizedModel::QuantizedModel(const std::vector<cpu::DenseLayer>& layers, const Normalization& norm, const ImageSet& calibration, int samples) {
+    if (layers.empty())
+        throw std::runtime_error("Cannot quantize a network without layers");
+    if (layers[0].inSize != calibration.pixels())
+        throw std::runtime_error("Calibration images have " + std::to_string(calibration.pixels()) +
+            " pixels, the network expects " + std::to_string(layers[0].inSize));
+    samples = std::min(samples, calibration.size());
+    if (samples <= 0)
+        throw std::runtime_error("Quantization needs at least one calibration image");
+
+    size_t size = 0;
+    for (size_t i = 0; i < layers.size(); i++) {
+        if (i > 0 && layers[i].inSize != layers[i - 1].outSize)
+            throw std::runtime_error("Layer " + std::to_string(i) + " expects " + std::to_string(layers[i].inSize) +
+                " inputs but receives " + std::to_string(layers[i - 1].outSize));
+        int stride = static_cast<int>(cpu::Arena::padded(layers[i].inSize));
+        size += cpu::Arena::padded(layers[i].outSize * stride / 4) + 2 * cpu::Arena::padded(layers[i].outSize);
+        width = std::max(width, layers[i].outSize);
+    }
+
+    // Output range of every layer over an evenly spaced sample of the calibration set
+    std::vector<float> lo(layers.size(), 0.0f), hi(layers.size(), 0.0f);
+    std::vector<float> x(std::max(layers[0].inSize, width)), y(width);
+    for (int s = 0; s < samples; s++) {
+        int row = static_cast<int>(static_cast<long long>(s) * calibration.size() / samples);
+        calibration.normalize(row, norm, x.data());
+        for (size_t l = 0; l < layers.size(); l++) {
+            auto& layer = layers[l];
+            cpu::sgemv(false, layer.outSize, layer.inSize, 1.0f, layer.W.data, layer.W.stride, x.data(), 0.0f, y.data(), layer.b.data, layer.activation);
+            auto range = std::minmax_element(y.begin(), y.begin() + layer.outSize);
+            lo[l] = s == 0 ? *range.first : std::min(lo[l], *range.first);
+            hi[l] = s == 0 ? *range.second : std::max(hi[l], *range.second);
+            std::copy(y.begin(), y.begin() + layer.outSize, x.begin());
+        }
+    }
+
+    weights = cpu::Arena(size);
+    // Raw pixels p normalize to (p / 255 - mean) / std = (p - 255 mean) / (255 std)
+    float inScale = 1.0f / (255.0f * norm.std);
+    float inZero = 255.0f * norm.mean;
+    for (size_t l = 0; l < layers.size(); l++) {
+        auto& layer = layers[l];
+        Layer q;
+        q.in = layer.inSize;
+        q.out = layer.outSize;
+        q.stride = static_cast<int>(cpu::Arena::padded(layer.inSize));
+        q.activation = layer.activation;
+
+        int8_t* W = reinterpret_cast<int8_t*>(weights.allocate(q.out * q.stride / 4));
+        float* scale = weights.allocate(q.out);
+        float* offset = weights.allocate(q.out);
+        for (int o = 0; o < q.out; o++) {
+            const float* w = layer.W.row(o);
+            float m = 0.0f;
+            for (int i = 0; i < q.in; i++) {
+                m = std::max(m, std::abs(w[i]));
+            }
+            float ws = m > 0.0f ? m / cpu::QWEIGHT_MAX : 1.0f;
+            int rowSum = 0;
+            for (int i = 0; i < q.in; i++) {
+                int v = static_cast<int>(std::round(w[i] / ws));
+                v = std::max(-cpu::QWEIGHT_MAX, std::min(cpu::QWEIGHT_MAX, v));
+                W[o * q.stride + i] = static_cast<int8_t>(v);
+                rowSum += v;
+            }
+            scale[o] = inScale * ws;
+            offset[o] = layer.b.data[o] - scale[o] * inZero * rowSum;
+        }
+        q.W = W;
+        q.scale = scale;
+        q.offset = offset;
+
+        if (l + 1 < layers.size()) {
+            activationRange(lo[l], hi[l], q.outScale, q.outZero);
+        }
+        else {
+            q.outScale = 1.0f;
+            q.outZero = 0.0f;
+        }
+        inScale = q.outScale;
+        inZero = q.outZero;
+        this->layers.push_back(q);
+    }
+}
+
+
+size_t QuantizedModel::weightBytes() const {
+    size_t bytes = 0;
+    for (auto& layer : layers) {
+        bytes += static_cast<size_t>(layer.out) * layer.stride + 2 * layer.out * sizeof(float);
+    }
+    return bytes;
+}
+
+
+float* QuantizedModel::scratch(int n) const {
+    size_t block = cpu::Arena::padded(static_cast<size_t>(n) * width);
+    size_t floats = 2 * block + 2 * cpu::Arena::padded((n * width + 3) / 4);
+    thread_local cpu::Arena buffers;
+    if (buffers.capacity() < floats)
+        buffers = cpu::Arena(floats);
+    buffers.reset();
+    return buffers.allocate(floats);
+}
+
+
+// Runs n images of raw pixels through the integer layers; scratch comes from scratch(n)
+void QuantizedModel::forward(const uint8_t* x, int n, int* predictions, float* scratch) const {
+    size_t block = cpu::Arena::padded(static_cast<size_t>(n) * width);
+    int32_t* acc = reinterpret_cast<int32_t*>(scratch);
+    float* y = scratch + block;
+    uint8_t* ping = reinterpret_cast<uint8_t*>(y + block);
+    uint8_t* pong = ping + cpu::Arena::padded((n * width + 3) / 4) * sizeof(float);
+
+    const uint8_t* in = x;
+    int lda = inputSize();
+    for (size_t l = 0; l < layers.size(); l++) {
+        const Layer& q = layers[l];
+        cpu::qgemm(n, q.out, q.in, in, lda, q.W, q.stride, acc, q.out);
+        for (int r = 0; r < n; r++) {
+            const int32_t* a = acc + r * q.out;
+            float* yr = y + r * q.out;
+            for (int o = 0; o < q.out; o++) {
+                yr[o] = q.scale[o] * a[o] + q.offset[o];
+            }
+            cpu::activate(q.activation, yr, q.out);
+        }
+
+        if (l + 1 == layers.size())
+            break;
+        float inv = 1.0f / q.outScale;
+        for (int i = 0; i < n * q.out; i++) {
+            float v = std::min(255.0f, std::max(0.0f, y[i] * inv + q.outZero));
+            ping[i] = static_cast<uint8_t>(v + 0.5f);
+        }
+        in = ping;
+        lda = q.out;
+        std::swap(ping, pong);
+    }
+
+    int c = classes();
+    for (int r = 0; r < n; r++) {
+        const float* yr = y + r * c;
+        predictions[r] = static_cast<int>(std::max_element(yr, yr + c) - yr);
+    }
+}
+
+
+int QuantizedModel::classify(const uint8_t* pixels) const {
+    int p;
+    forward(pixels, 1, &p, scratch(1));
+    return p;
+}
+
+
+void QuantizedModel::classifyBatch(const uint8_t* pixels, int n, int* predictions) const {
+    float* buffers = scratch(std::min(n, chunk));
+    size_t stride = inputSize();
+    for (int begin = 0; begin < n; begin += chunk) {
+        forward(pixels + begin * stride, std::min(chunk, n - begin), predictions + begin, buffers);
+    }
+}
+
+
+float QuantizedModel::evaluate(const ImageSet& images, const std::vector<int>& labels, ConfusionMatrix& confusion) const {
+    int n = std::min(images.size(), static_cast<int>(labels.size()));
+    confusion.reset();
+    int predictions[chunk];
+    for (int begin = 0; begin < n; begin += chunk) {
+        int count = std::min(chunk, n - begin);
+        classifyBatch(images.image(begin), count, predictions);
+        for (int i = 0; i < count; i++) {
+            confusion.add(predictions[i], labels[begin + i]);
+        }
+    }
+    return confusion.accuracy();
+}
+
+
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "Arena.h"
+#include "Dataset.h"
+#include "DenseLayer.h"
+#include "Metrics.h"
+
+
+namespace nn {
+
+
+// Post-training int8 quantization of a trained network. Weights are quantized per output
+// channel; each hidden activation gets a per-tensor uint8 scale and zero point calibrated
+// on a sample of the training images. The first layer consumes the raw pixels directly,
+// with the input normalization folded into its bias. Like InferenceModel it is read-only
+// after construction and safe to share between threads.
+class QuantizedModel {
+public:
+    static const int chunk = 64;
+
+    QuantizedModel(const std::vector<cpu::DenseLayer>& layers, const Normalization& norm, const ImageSet& calibration, int samples);
+
+    int inputSize() const { return layers.front().in; }
+    int classes() const { return layers.back().out; }
+    // Bytes of packed int8 weights and float per-channel parameters, without the block's
+    // alignment padding
+    size_t weightBytes() const;
+
+    int classify(const uint8_t* pixels) const;
+    void classifyBatch(const uint8_t* pixels, int n, int* predictions) const;
+
+    // Classifies every image, fills confusion and returns the accuracy
+    float evaluate(const ImageSet& images, const std::vector<int>& labels, ConfusionMatrix& confusion) const;
+
+private:
+    struct Layer {
+        int in;
+        int out;
+        int stride;
+        const int8_t* W;
+        // y = scale * (W x) + offset for the integer product of quantized x and W
+        const float* scale;
+        const float* offset;
+        cpu::Activation activation;
+        // Quantization of this layer's output: q = y / outScale + outZero
+        float outScale;
+        float outZero;
+    };
+
+    cpu::Arena weights;
+    std::vector<Layer> layers;
+    int width = 0;
+
+    void forward(const uint8_t* x, int n, int* predictions, float* scratch) const;
+    float* scratch(int n) const;
+};
+
+
+}
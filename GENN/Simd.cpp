@@ -0,0 +1,128 @@
+#include "pch.h"
+#include "Simd.h"
+
+#if defined(GENN_X86)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+
+namespace cpu {
+namespace simd {
+
+
+#if defined(GENN_X86)
+static void cpuid(int regs[4], int leaf, int sub) {
+#if defined(_MSC_VER)
+    __cpuidex(regs, leaf, sub);
+#else
+    unsigned int a, b, c, d;
+    __cpuid_count(leaf, sub, a, b, c, d);
+    regs[0] = a; regs[1] = b; regs[2] = c; regs[3] = d;
+#endif
+}
+
+
+static unsigned long long xgetbv() {
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    unsigned int lo, hi;
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return (static_cast<unsigned long long>(hi) << 32) | lo;
+#endif
+}
+#endif
+
+
+static Level detect() {
+#if defined(GENN_X86)
+    int r[4];
+    cpuid(r, 0, 0);
+    if (r[0] < 7)
+        return Level::scalar;
+
+    cpuid(r, 1, 0);
+    bool osxsave = (r[2] & (1 << 27)) != 0;
+    bool fma = (r[2] & (1 << 12)) != 0;
+    bool f16c = (r[2] & (1 << 29)) != 0;
+    if (!osxsave || !fma || !f16c)
+        return Level::scalar;
+
+    unsigned long long xcr0 = xgetbv();
+    cpuid(r, 7, 0);
+    bool avx2 = (r[1] & (1 << 5)) != 0 && (xcr0 & 0x6) == 0x6;
+    bool avx512 = (r[1] & (1 << 16)) != 0 && (xcr0 & 0xe6) == 0xe6;
+    if (avx2 && avx512)
+        return Level::avx512;
+    if (avx2)
+        return Level::avx2;
+#endif
+    return Level::scalar;
+}
+
+
+static bool detectVnni() {
+#if defined(GENN_X86)
+    if (detect() != Level::avx512)
+        return false;
+    int r[4];
+    cpuid(r, 7, 0);
+    bool bw = (r[1] & (1 << 30)) != 0;
+    bool vnni = (r[2] & (1 << 11)) != 0;
+    return bw && vnni;
+#else
+    return false;
+#endif
+}
+
+
+static bool detectBf16() {
+#if defined(GENN_X86)
+    if (detect() != Level::avx512)
+        return false;
+    int r[4];
+    cpuid(r, 7, 0);
+    if (r[0] < 1)
+        return false;
+    cpuid(r, 7, 1);
+    return (r[0] & (1 << 5)) != 0;
+#else
+    return false;
+#endif
+}
+
+
+static Level& current() {
+    static Level l = detect();
+    return l;
+}
+
+
+Level level() {
+    return current();
+}
+
+
+void setLevel(Level l) {
+    current() = std::min(l, detect());
+}
+
+
+bool vnni() {
+    static bool supported = detectVnni();
+    return supported && level() == Level::avx512;
+}
+
+
+bool bf16() {
+    static bool supported = detectBf16();
+    return supported && level() == Level::avx512;
+}
+
+
+}
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define GENN_X86
+#include <immintrin.h>
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#define GENN_TARGET_AVX2
+#define GENN_TARGET_AVX512
+#define GENN_TARGET_VNNI
+#define GENN_TARGET_BF16
+#else
+#define GENN_TARGET_AVX2 __attribute__((target("avx2,fma,f16c")))
+#define GENN_TARGET_AVX512 __attribute__((target("avx512f,avx2,fma,f16c")))
+#define GENN_TARGET_VNNI __attribute__((target("avx512vnni,avx512bw,avx512f,avx2,fma")))
+#define GENN_TARGET_BF16 __attribute__((target("avx512bf16,avx512bw,avx512f,avx2,fma,f16c")))
+#endif
+
+
+namespace cpu {
+namespace simd {
+
+
+enum Level { scalar, avx2, avx512 };
+
+// Highest instruction set supported by both the CPU and the OS, capped by setLevel()
+Level level();
+void setLevel(Level l);
+// AVX-512 VNNI int8 dot products, usable when level() is avx512
+bool vnni();
+// AVX-512 BF16 conversions, usable when level() is avx512
+bool bf16();
+
+
+}
+}
@@ -0,0 +1,99 @@
+#include "pch.h"
+#include "Source.h"
+#include <climits>
+
+
+namespace nn {
+
+
+MemorySource::MemorySource(const ImageSet& images, const std::vector<int>& labels) : images(images), labels(labels) {
+    if ((int)labels.size() != images.size())
+        throw std::runtime_error("Image and label counts differ: " + std::to_string(images.size()) + " vs " + std::to_string(labels.size()));
+}
+
+
+void MemorySource::read(int first, int n, uint8_t* images, int* labels) {
+    memcpy(images, this->images.image(first), static_cast<size_t>(n) * pixels());
+    memcpy(labels, &this->labels[first], n * sizeof(int));
+}
+
+
+static std::streamoff openIdx(const std::string& filename, std::unique_ptr<std::ifstream>& stream, std::vector<int>& shape) {
+    stream.reset(new std::ifstream(filename, std::ios::binary));
+    if (!stream->is_open())
+        throw std::runtime_error("Cannot open " + filename);
+    stream->seekg(0, std::ios::end);
+    size_t fileSize = static_cast<size_t>(stream->tellg());
+    stream->seekg(0);
+    uint8_t header[1024];
+    stream->read(reinterpret_cast<char*>(header), std::min<size_t>(fileSize, sizeof(header)));
+    return static_cast<std::streamoff>(parseIdxHeader(header, fileSize, filename, shape));
+}
+
+
+IdxStreamSource::IdxStreamSource(const std::vector<std::pair<std::string, std::string>>& shards) {
+    long long count = 0;
+    for (auto& files : shards) {
+        Shard s;
+        std::vector<int> imageShape;
+        std::vector<int> labelShape;
+        s.imageOffset = openIdx(files.first, s.images, imageShape);
+        s.labelOffset = openIdx(files.second, s.labels, labelShape);
+        if (imageShape.size() != 3)
+            throw std::runtime_error(files.first + " must have 3 dimensions, got " + std::to_string(imageShape.size()));
+        if (labelShape.size() != 1)
+            throw std::runtime_error(files.second + " must have 1 dimension, got " + std::to_string(labelShape.size()));
+        if (imageShape[0] != labelShape[0])
+            throw std::runtime_error(files.first + " and " + files.second + " differ in sample count");
+        if (this->shards.empty()) {
+            h = imageShape[1];
+            w = imageShape[2];
+        }
+        else if (imageShape[1] != h || imageShape[2] != w)
+            throw std::runtime_error(files.first + " differs in image size from the first shard");
+
+        s.first = static_cast<int>(count);
+        s.count = imageShape[0];
+        s.cursor = -1;
+        count += s.count;
+        if (count > INT_MAX)
+            throw std::runtime_error("IDX shards hold more than " + std::to_string(INT_MAX) + " samples");
+        this->shards.push_back(std::move(s));
+    }
+    total = static_cast<int>(count);
+}
+
+
+// Seeks only when the read does not continue where the previous one stopped
+void IdxStreamSource::read(int first, int n, uint8_t* images, int* labels) {
+    auto it = std::upper_bound(shards.begin(), shards.end(), first, [](int i, const Shard& s) { return i < s.first; }) - 1;
+    while (n > 0) {
+        Shard& s = *it;
+        int i = first - s.first;
+        int m = std::min(n, s.count - i);
+        if (s.cursor != i) {
+            s.images->clear();
+            s.labels->clear();
+            s.images->seekg(s.imageOffset + static_cast<std::streamoff>(i) * pixels());
+            s.labels->seekg(s.labelOffset + i);
+        }
+        labelBuffer.resize(m);
+        s.images->read(reinterpret_cast<char*>(images), static_cast<std::streamsize>(m) * pixels());
+        s.labels->read(reinterpret_cast<char*>(labelBuffer.data()), m);
+        if (!*s.images || !*s.labels)
+            throw std::runtime_error("Short read from IDX shard " + std::to_string(it - shards.begin()));
+        for (int k = 0; k < m; k++) {
+            labels[k] = labelBuffer[k];
+        }
+        s.cursor = i + m;
+
+        first += m;
+        n -= m;
+        images += static_cast<size_t>(m) * pixels();
+        labels += m;
+        ++it;
+    }
+}
+
+
+}
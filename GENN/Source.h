@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "Dataset.h"
+
+
+namespace nn {
+
+
+// Labelled images the trainer streams from. Sources are read by one thread at a time.
+class SampleSource {
+public:
+    virtual ~SampleSource() {}
+
+    virtual int size() const = 0;
+    virtual int rows() const = 0;
+    virtual int cols() const = 0;
+    int pixels() const { return rows() * cols(); }
+
+    // True when samples are held in memory, so random access costs no more than a scan
+    virtual bool resident() const = 0;
+
+    // Copies samples [first, first + n) into images (n * pixels() bytes) and labels
+    virtual void read(int first, int n, uint8_t* images, int* labels) = 0;
+};
+
+
+class MemorySource : public SampleSource {
+public:
+    MemorySource(const ImageSet& images, const std::vector<int>& labels);
+
+    int size() const override { return images.size(); }
+    int rows() const override { return images.rows(); }
+    int cols() const override { return images.cols(); }
+    bool resident() const override { return true; }
+    void read(int first, int n, uint8_t* images, int* labels) override;
+
+private:
+    ImageSet images;
+    std::vector<int> labels;
+};
+
+
+// Concatenation of (images, labels) IDX file pairs read in chunks through buffered
+// streams, so memory use does not depend on the corpus size
+class IdxStreamSource : public SampleSource {
+public:
+    explicit IdxStreamSource(const std::vector<std::pair<std::string, std::string>>& shards);
+
+    int size() const override { return total; }
+    int rows() const override { return h; }
+    int cols() const override { return w; }
+    bool resident() const override { return false; }
+    void read(int first, int n, uint8_t* images, int* labels) override;
+
+private:
+    struct Shard {
+        std::unique_ptr<std::ifstream> images;
+        std::unique_ptr<std::ifstream> labels;
+        std::streamoff imageOffset;
+        std::streamoff labelOffset;
+        int first;
+        int count;
+        int cursor;
+    };
+
+    std::vector<Shard> shards;
+    std::vector<uint8_t> labelBuffer;
+    int total = 0;
+    int h = 0;
+    int w = 0;
+};
+
+
+}
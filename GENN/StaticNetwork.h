@@ -0,0 +1,279 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "Activation.h"
+#include "Arena.h"
+#include "DenseLayer.h"
+#include "Simd.h"
+
+
+namespace cpu {
+
+
+// Register blocks of a static layer's output row, unrolled by template recursion so each
+// accumulator is a named register rather than an array in memory. Only these blocks are
+// unrolled; the loop over the inputs stays a loop, with a constant trip count. Lanes j and
+// j+Regs of acc are two independent chains over alternating inputs, halving the FMA
+// dependency depth.
+#if defined(GENN_X86)
+template<int J, int Regs>
+struct UnrollAvx2 {
+    GENN_TARGET_AVX2 static void init(__m256* acc, const float* b) {
+        acc[J] = _mm256_load_ps(b + 8 * J);
+        acc[J + Regs] = _mm256_setzero_ps();
+        UnrollAvx2<J + 1, Regs>::init(acc, b);
+    }
+    GENN_TARGET_AVX2 static void fma(__m256* acc, const float* w, __m256 x) {
+        acc[J] = _mm256_fmadd_ps(_mm256_load_ps(w + 8 * J), x, acc[J]);
+        UnrollAvx2<J + 1, Regs>::fma(acc, w, x);
+    }
+    GENN_TARGET_AVX2 static void fma2(__m256* acc, const float* w, __m256 x) {
+        acc[J + Regs] = _mm256_fmadd_ps(_mm256_load_ps(w + 8 * J), x, acc[J + Regs]);
+        UnrollAvx2<J + 1, Regs>::fma2(acc, w, x);
+    }
+    GENN_TARGET_AVX2 static void store(const __m256* acc, float* y) {
+        _mm256_storeu_ps(y + 8 * J, _mm256_add_ps(acc[J], acc[J + Regs]));
+        UnrollAvx2<J + 1, Regs>::store(acc, y);
+    }
+};
+
+template<int Regs>
+struct UnrollAvx2<Regs, Regs> {
+    GENN_TARGET_AVX2 static void init(__m256*, const float*) {}
+    GENN_TARGET_AVX2 static void fma(__m256*, const float*, __m256) {}
+    GENN_TARGET_AVX2 static void fma2(__m256*, const float*, __m256) {}
+    GENN_TARGET_AVX2 static void store(const __m256*, float*) {}
+};
+
+
+template<int J, int Regs>
+struct UnrollAvx512 {
+    GENN_TARGET_AVX512 static void init(__m512* acc, const float* b) {
+        acc[J] = _mm512_load_ps(b + 16 * J);
+        acc[J + Regs] = _mm512_setzero_ps();
+        UnrollAvx512<J + 1, Regs>::init(acc, b);
+    }
+    GENN_TARGET_AVX512 static void fma(__m512* acc, const float* w, __m512 x) {
+        acc[J] = _mm512_fmadd_ps(_mm512_load_ps(w + 16 * J), x, acc[J]);
+        UnrollAvx512<J + 1, Regs>::fma(acc, w, x);
+    }
+    GENN_TARGET_AVX512 static void fma2(__m512* acc, const float* w, __m512 x) {
+        acc[J + Regs] = _mm512_fmadd_ps(_mm512_load_ps(w + 16 * J), x, acc[J + Regs]);
+        UnrollAvx512<J + 1, Regs>::fma2(acc, w, x);
+    }
+    GENN_TARGET_AVX512 static void store(const __m512* acc, float* y) {
+        _mm512_storeu_ps(y + 16 * J, _mm512_add_ps(acc[J], acc[J + Regs]));
+        UnrollAvx512<J + 1, Regs>::store(acc, y);
+    }
+};
+
+template<int Regs>
+struct UnrollAvx512<Regs, Regs> {
+    GENN_TARGET_AVX512 static void init(__m512*, const float*) {}
+    GENN_TARGET_AVX512 static void fma(__m512*, const float*, __m512) {}
+    GENN_TARGET_AVX512 static void fma2(__m512*, const float*, __m512) {}
+    GENN_TARGET_AVX512 static void store(const __m512*, float*) {}
+};
+#endif
+
+
+// Fully connected layer with sizes and activation fixed at compile time. Weights are
+// loaded from a DenseLayer (row-major out x in) and kept transposed, in x padded(out), so
+// the whole output row lives in registers and every loop has a constant trip count.
+template<int In, int Out, Activation A>
+class StaticDense {
+public:
+    static const int inputs = In;
+    static const int outputs = Out;
+    static const int width = (Out + 15) / 16 * 16;
+
+    StaticDense() : storage(static_cast<size_t>(In) * width + width) {
+        Wt = storage.allocate(static_cast<size_t>(In) * width);
+        b = storage.allocate(width);
+        kernel = selectKernel();
+    }
+
+    void load(const DenseLayer& layer) {
+        if (layer.inSize != In || layer.outSize != Out || layer.activation != A)
+            throw std::runtime_error("Layer " + std::to_string(layer.inSize) + "x" + std::to_string(layer.outSize) + " " +
+                activationName(layer.activation) + " does not match static layer " + std::to_string(In) + "x" +
+                std::to_string(Out) + " " + activationName(A));
+        for (int o = 0; o < Out; o++) {
+            const float* w = layer.W.row(o);
+            for (int i = 0; i < In; i++) {
+                Wt[i * width + o] = w[i];
+            }
+            b[o] = layer.b.data[o];
+        }
+    }
+
+    // y holds width floats; the first Out are the activations
+    void forward(const float* x, float* y) const {
+        kernel(Wt, b, x, y);
+        activate(A, y, Out);
+    }
+
+private:
+    typedef void(*Kernel)(const float* Wt, const float* b, const float* x, float* y);
+
+    Arena storage;
+    float* Wt;
+    float* b;
+    Kernel kernel;
+
+    static void kernelScalar(const float* Wt, const float* b, const float* x, float* y) {
+        float acc[width];
+        for (int o = 0; o < width; o++) {
+            acc[o] = b[o];
+        }
+        for (int i = 0; i < In; i++) {
+            const float* w = Wt + i * width;
+            for (int o = 0; o < width; o++) {
+                acc[o] += w[o] * x[i];
+            }
+        }
+        for (int o = 0; o < width; o++) {
+            y[o] = acc[o];
+        }
+    }
+
+#if defined(GENN_X86)
+    GENN_TARGET_AVX2 static void kernelAvx2(const float* Wt, const float* b, const float* x, float* y) {
+        const int regs = width / 8;
+        __m256 acc[2 * regs];
+        UnrollAvx2<0, regs>::init(acc, b);
+        int i = 0;
+        for (; i + 1 < In; i += 2) {
+            UnrollAvx2<0, regs>::fma(acc, Wt + i * width, _mm256_broadcast_ss(x + i));
+            UnrollAvx2<0, regs>::fma2(acc, Wt + (i + 1) * width, _mm256_broadcast_ss(x + i + 1));
+        }
+        if (i < In) {
+            UnrollAvx2<0, regs>::fma(acc, Wt + i * width, _mm256_broadcast_ss(x + i));
+        }
+        UnrollAvx2<0, regs>::store(acc, y);
+    }
+
+    GENN_TARGET_AVX512 static void kernelAvx512(const float* Wt, const float* b, const float* x, float* y) {
+        const int regs = width / 16;
+        __m512 acc[2 * regs];
+        UnrollAvx512<0, regs>::init(acc, b);
+        int i = 0;
+        for (; i + 1 < In; i += 2) {
+            UnrollAvx512<0, regs>::fma(acc, Wt + i * width, _mm512_set1_ps(x[i]));
+            UnrollAvx512<0, regs>::fma2(acc, Wt + (i + 1) * width, _mm512_set1_ps(x[i + 1]));
+        }
+        if (i < In) {
+            UnrollAvx512<0, regs>::fma(acc, Wt + i * width, _mm512_set1_ps(x[i]));
+        }
+        UnrollAvx512<0, regs>::store(acc, y);
+    }
+#endif
+
+    static Kernel selectKernel() {
+#if defined(GENN_X86)
+        switch (simd::level()) {
+        case simd::avx512:
+            return kernelAvx512;
+        case simd::avx2:
+            return kernelAvx2;
+        default:
+            break;
+        }
+#endif
+        return kernelScalar;
+    }
+};
+
+
+template<typename... Layers>
+class StaticNetwork;
+
+
+template<typename Last>
+class StaticNetwork<Last> {
+public:
+    static const int inputs = Last::inputs;
+    static const int outputs = Last::outputs;
+    static const int depth = 1;
+
+    void load(const std::vector<DenseLayer>& layers) {
+        if ((int)layers.size() != depth)
+            throw std::runtime_error("Expected 1 layer, got " + std::to_string(layers.size()));
+        load(layers.data());
+    }
+
+    void load(const DenseLayer* layers) {
+        layer.load(layers[0]);
+    }
+
+    void forward(const float* x, float* y) const {
+        alignas(64) float h[Last::width];
+        layer.forward(x, h);
+        memcpy(y, h, outputs * sizeof(float));
+    }
+
+    int classify(const float* x) const {
+        float y[outputs];
+        forward(x, y);
+        return static_cast<int>(std::max_element(y, y + outputs) - y);
+    }
+
+private:
+    Last layer;
+};
+
+
+// Chain of StaticDense layers evaluated one sample at a time with stack temporaries;
+// consecutive layer sizes are checked at compile time
+template<typename First, typename Next, typename... Rest>
+class StaticNetwork<First, Next, Rest...> {
+public:
+    static_assert(First::outputs == Next::inputs, "Consecutive static layers must agree in size");
+
+    static const int inputs = First::inputs;
+    static const int outputs = StaticNetwork<Next, Rest...>::outputs;
+    static const int depth = 1 + StaticNetwork<Next, Rest...>::depth;
+
+    void load(const std::vector<DenseLayer>& layers) {
+        if ((int)layers.size() != depth)
+            throw std::runtime_error("Expected " + std::to_string(depth) + " layers, got " + std::to_string(layers.size()));
+        load(layers.data());
+    }
+
+    void load(const DenseLayer* layers) {
+        layer.load(layers[0]);
+        rest.load(layers + 1);
+    }
+
+    void forward(const float* x, float* y) const {
+        alignas(64) float h[First::width];
+        layer.forward(x, h);
+        rest.forward(h, y);
+    }
+
+    int classify(const float* x) const {
+        float y[outputs];
+        forward(x, y);
+        return static_cast<int>(std::max_element(y, y + outputs) - y);
+    }
+
+private:
+    First layer;
+    StaticNetwork<Next, Rest...> rest;
+};
+
+
+// The only instantiation. InferenceModel uses it when the layers are exactly
+// 784-64:sigmoid-64:sigmoid-10:linear; every other topology, e.g. one given with
+// Network::topology, takes InferenceModel's generic path.
+typedef StaticNetwork<
+    StaticDense<784, 64, Activation::sigmoid>,
+    StaticDense<64, 64, Activation::sigmoid>,
+    StaticDense<64, 10, Activation::linear>> MnistNetwork;
+
+
+}
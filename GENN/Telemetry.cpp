@@ -0,0 +1,96 @@
+#include "pch.h"
+#include "Telemetry.h"
+
+
+namespace nn {
+
+
+void Telemetry::reset(int epochSize, long long position) {
+    this->epochSize = std::max(1, epochSize);
+    lossSum = 0.0;
+    current = TelemetrySnapshot();
+    current.position = position;
+    current.epoch = static_cast<int>(position / this->epochSize);
+    losses.clear();
+    predictions.clear();
+    windowMeans.clear();
+    confusion->reset();
+    publish();
+}
+
+
+void Telemetry::setClasses(int classes) {
+    if (confusion->classes() != classes)
+        std::atomic_store(&confusion, std::make_shared<ConfusionMatrix>(classes));
+}
+
+
+void Telemetry::record(int sample, int prediction, int label, float loss) {
+    if (current.position > 0 && current.position % epochSize == 0) {
+        ++current.epoch;
+        current.epochSamples = 0;
+        current.epochCorrect = 0;
+        confusion->reset();
+    }
+
+    if (losses.size() >= lossWindow) {
+        lossSum -= losses.back(lossWindow - 1);
+    }
+    losses.push(loss);
+    predictions.push(Prediction{ sample, prediction });
+    lossSum += loss;
+
+    ++current.position;
+    ++current.epochSamples;
+    current.epochCorrect += prediction == label ? 1 : 0;
+    confusion->add(prediction, label);
+    current.meanLoss = static_cast<float>(lossSum / std::min<long long>(lossWindow, losses.size()));
+    if (current.position % lossWindow == 0) {
+        windowMeans.push(current.meanLoss);
+    }
+    publish();
+}
+
+
+void Telemetry::publish() {
+    unsigned int s = sequence.load(std::memory_order_relaxed);
+    sequence.store(s + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    position.store(current.position, std::memory_order_relaxed);
+    epoch.store(current.epoch, std::memory_order_relaxed);
+    epochSamples.store(current.epochSamples, std::memory_order_relaxed);
+    epochCorrect.store(current.epochCorrect, std::memory_order_relaxed);
+    meanLoss.store(current.meanLoss, std::memory_order_relaxed);
+    sequence.store(s + 2, std::memory_order_release);
+}
+
+
+TelemetrySnapshot Telemetry::snapshot() const {
+    TelemetrySnapshot r;
+    while (true) {
+        unsigned int s = sequence.load(std::memory_order_acquire);
+        if (s & 1)
+            continue;
+        r.position = position.load(std::memory_order_relaxed);
+        r.epoch = epoch.load(std::memory_order_relaxed);
+        r.epochSamples = epochSamples.load(std::memory_order_relaxed);
+        r.epochCorrect = epochCorrect.load(std::memory_order_relaxed);
+        r.meanLoss = meanLoss.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence.load(std::memory_order_relaxed) == s)
+            return r;
+    }
+}
+
+
+std::vector<Prediction> Telemetry::latestPredictions(int n) const {
+    return predictions.latest(n);
+}
+
+
+std::vector<float> Telemetry::lossHistory() const {
+    return windowMeans.latest(windowMeans.capacity);
+}
+
+
+}
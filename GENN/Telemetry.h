@@ -0,0 +1,127 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "Metrics.h"
+
+
+namespace nn {
+
+
+// Single-producer ring of the most recent N values. Readers copy a window without
+// locking and retry if the producer overwrote part of it while they were copying.
+template<typename T, int N>
+class RingBuffer {
+    static_assert(N > 0 && (N & (N - 1)) == 0, "RingBuffer capacity must be a power of two");
+
+public:
+    static const int capacity = N;
+
+    void push(T value) {
+        long long h = head.load(std::memory_order_relaxed);
+        writing.store(h + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slots[h & (N - 1)].store(value, std::memory_order_relaxed);
+        head.store(h + 1, std::memory_order_release);
+    }
+
+    // Producer only: the value pushed `age` pushes ago, age < N
+    T back(int age) const {
+        return slots[(head.load(std::memory_order_relaxed) - 1 - age) & (N - 1)].load(std::memory_order_relaxed);
+    }
+
+    long long size() const {
+        return head.load(std::memory_order_acquire);
+    }
+
+    // Up to n of the most recent values, oldest first
+    std::vector<T> latest(int n) const {
+        std::vector<T> r;
+        while (true) {
+            long long h = head.load(std::memory_order_acquire);
+            int k = static_cast<int>(std::min<long long>(std::min(n, N), h));
+            r.resize(k);
+            for (int i = 0; i < k; i++) {
+                r[i] = slots[(h - k + i) & (N - 1)].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (writing.load(std::memory_order_relaxed) - N <= h - k)
+                return r;
+        }
+    }
+
+    void clear() {
+        head.store(0, std::memory_order_release);
+        writing.store(0, std::memory_order_release);
+    }
+
+private:
+    std::atomic<T> slots[N] = {};
+    std::atomic<long long> head{ 0 };
+    std::atomic<long long> writing{ 0 };
+};
+
+
+// A dataset row and the class predicted for it
+struct Prediction {
+    int sample;
+    int predicted;
+};
+
+
+struct TelemetrySnapshot {
+    long long position = 0;
+    int epoch = 0;
+    long long epochSamples = 0;
+    long long epochCorrect = 0;
+    float meanLoss = 0.0f;
+
+    float accuracy() const {
+        return epochSamples > 0 ? static_cast<float>(epochCorrect) / epochSamples : 0.0f;
+    }
+};
+
+
+// Training statistics written by the trainer thread once per sample and read by the UI.
+// Aggregates are published through a sequence lock, so snapshot() never blocks the
+// trainer, and all history is held in fixed-size rings.
+class Telemetry {
+public:
+    static const int lossWindow = 1000;
+
+    // Starts counting at position, e.g. when training resumes from a checkpoint
+    void reset(int epochSize, long long position = 0);
+    void record(int sample, int prediction, int label, float loss);
+
+    TelemetrySnapshot snapshot() const;
+    std::vector<Prediction> latestPredictions(int n) const;
+    std::vector<float> lossHistory() const;
+    std::shared_ptr<const ConfusionMatrix> epochConfusion() const { return std::atomic_load(&confusion); }
+    // Swaps in an epoch confusion matrix of this size, so readers keep the one they hold;
+    // call while nothing records
+    void setClasses(int classes);
+
+private:
+    RingBuffer<float, 1024> losses;
+    RingBuffer<Prediction, 256> predictions;
+    RingBuffer<float, 1024> windowMeans;
+    std::shared_ptr<ConfusionMatrix> confusion = std::make_shared<ConfusionMatrix>();
+
+    int epochSize = 1;
+    double lossSum = 0.0;
+    TelemetrySnapshot current;
+
+    std::atomic<unsigned int> sequence{ 0 };
+    std::atomic<long long> position{ 0 };
+    std::atomic<int> epoch{ 0 };
+    std::atomic<long long> epochSamples{ 0 };
+    std::atomic<long long> epochCorrect{ 0 };
+    std::atomic<float> meanLoss{ 0.0f };
+
+    void publish();
+};
+
+
+}
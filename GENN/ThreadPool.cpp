@@ -0,0 +1,87 @@
+#include "pch.h"
+#include "ThreadPool.h"
+
+
+namespace cpu {
+
+
+ThreadPool::ThreadPool(int threads) {
+    for (int i = 1; i < threads; i++) {
+        workers.emplace_back(&ThreadPool::work, this, i);
+    }
+}
+
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> guard(m);
+        stopping = true;
+    }
+    started.notify_all();
+    for (auto& t : workers) {
+        t.join();
+    }
+}
+
+
+void ThreadPool::runTasks(int id) {
+    for (int i = id; i < taskCount; i += size()) {
+        try {
+            (*job)(i);
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> guard(m);
+            if (!error)
+                error = std::current_exception();
+        }
+    }
+}
+
+
+void ThreadPool::run(int tasks, const std::function<void(int)>& f) {
+    if (workers.empty()) {
+        for (int i = 0; i < tasks; i++) {
+            f(i);
+        }
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(m);
+        job = &f;
+        taskCount = tasks;
+        pending = static_cast<int>(workers.size());
+        error = nullptr;
+        ++generation;
+    }
+    started.notify_all();
+    runTasks(0);
+
+    std::unique_lock<std::mutex> lock(m);
+    finished.wait(lock, [this] { return pending == 0; });
+    job = nullptr;
+    if (error)
+        std::rethrow_exception(error);
+}
+
+
+void ThreadPool::work(int id) {
+    unsigned int seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m);
+            started.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping)
+                return;
+            seen = generation;
+        }
+        runTasks(id);
+        {
+            std::lock_guard<std::mutex> guard(m);
+            --pending;
+        }
+        finished.notify_one();
+    }
+}
+
+
+}
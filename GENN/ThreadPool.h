@@ -0,0 +1,43 @@
+#pragma once
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace cpu {
+
+
+// Fixed set of workers for fork-join loops. Task i always runs on worker i % size(),
+// the calling thread being worker 0, so a given task count maps to threads reproducibly.
+class ThreadPool {
+public:
+    explicit ThreadPool(int threads);
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator= (const ThreadPool&) = delete;
+    ~ThreadPool();
+
+    int size() const { return static_cast<int>(workers.size()) + 1; }
+    void run(int tasks, const std::function<void(int)>& f);
+
+private:
+    void work(int id);
+    void runTasks(int id);
+
+    std::vector<std::thread> workers;
+    std::mutex m;
+    std::condition_variable started;
+    std::condition_variable finished;
+    const std::function<void(int)>* job = nullptr;
+    std::exception_ptr error;
+    int taskCount = 0;
+    int pending = 0;
+    unsigned int generation = 0;
+    bool stopping = false;
+};
+
+
+}
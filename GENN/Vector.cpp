@@ -1,23 +1,25 @@
 #include "pch.h"
 #include "Vector.h"
+#include "Arena.h"
 
 
 namespace cpu {
 
 
+void indexError(const char* type, const char* dim, int size, int index) {
+    throw std::runtime_error("Overindexing " + std::string(type) + ". " + dim + ": " + std::to_string(size) + ", index: " + std::to_string(index));
+}
+
+
 Vector::Vector(int s = 0) : s(s) {
-    data = (float*)malloc(s * sizeof(float));
-    for (int i = 0; i < s; i++) {
-        data[i] = 0.f;
-    }
+    data = static_cast<float*>(alignedAlloc(s * sizeof(float)));
+    memset(data, 0, s * sizeof(float));
 }
 
 
 Vector::Vector(const Vector& v) : s(v.s) {
-    data = (float*)malloc(s * sizeof(float));
-    for (int i = 0; i < s; i++) {
-        data[i] = v[i];
-    }
+    data = static_cast<float*>(alignedAlloc(s * sizeof(float)));
+    memcpy(data, v.data, s * sizeof(float));
 }
 
 
@@ -30,9 +32,11 @@ Vector::Vector(Vector&& v) noexcept {
 
 Vector& Vector::operator=(const Vector& v) {
     if (this != &v) {
-        s = v.s;
-        free(data);
-        data = (float*)malloc(s * sizeof(float));
+        if (s != v.s || data == nullptr) {
+            alignedFree(data);
+            s = v.s;
+            data = static_cast<float*>(alignedAlloc(s * sizeof(float)));
+        }
         memcpy(data, v.data, s * sizeof(float));
     }
     return *this;
@@ -40,7 +44,7 @@ Vector& Vector::operator=(const Vector& v) {
 
 
 Vector& Vector::operator=(Vector&& v) noexcept {
-    free(data);
+    alignedFree(data);
     s = v.s;
     data = v.data;
     v.data = nullptr;
@@ -49,23 +53,7 @@ Vector& Vector::operator=(Vector&& v) noexcept {
 
 
 Vector::~Vector() {
-    free(data);
-}
-
-
-float& Vector::operator[](int i) {
-    if (i > s)
-        throw std::runtime_error("Overindexing Vector. Length: " + std::to_string(s + 1) + ", index: " + std::to_string(i));
-
-    return data[i];
-}
-
-
-const float& Vector::operator[](int i) const {
-    if (i > s)
-        throw std::runtime_error("Overindexing Vector. Length: " + std::to_string(s + 1) + ", index: " + std::to_string(i));
-
-    return data[i];
+    alignedFree(data);
 }
 
 
@@ -74,7 +62,7 @@ Vector Vector::operator+(const Vector& v) {
         throw std::runtime_error("Trying to add Vectors with different sizes: (" + std::to_string(s) + ", " + std::to_string(v.s) + ")");
     Vector r(s);
     for (int i = 0; i < v.s; i++) {
-        r[i] = v[i] + data[i];
+        r.data[i] = v.data[i] + data[i];
     }
     return r;
 }
@@ -1,12 +1,47 @@
 #pragma once
 
+#if defined(_DEBUG) && !defined(GENN_CHECKED)
+#define GENN_CHECKED
+#endif
+
+
 namespace cpu {
 
 
+[[noreturn]] void indexError(const char* type, const char* dim, int size, int index);
+
+
+template <typename T>
+class VectorViewT {
+public:
+    T* data = nullptr;
+    int s = 0;
+
+    VectorViewT() = default;
+    VectorViewT(T* data, int s) : data(data), s(s) {}
+    template <typename U>
+    VectorViewT(const VectorViewT<U>& v) : data(v.data), s(v.s) {}
+
+    T& operator[] (int i) const {
+#ifdef GENN_CHECKED
+        if (i < 0 || i >= s)
+            indexError("Vector", "Length", s, i);
+#endif
+        return data[i];
+    }
+
+    T* begin() const { return data; }
+    T* end() const { return data + s; }
+};
+
+typedef VectorViewT<float> VectorView;
+typedef VectorViewT<const float> ConstVectorView;
+
+
 class Vector {
 public:
-    int s;
-    float* data;
+    int s = 0;
+    float* data = nullptr;
 
     Vector() = default;
     Vector(int s);
@@ -16,8 +51,25 @@ public:
     Vector& operator= (Vector&& v) noexcept;
     ~Vector();
 
-    float& operator[] (int i);
-    const float& operator[] (int i) const;
+    float& operator[] (int i) {
+#ifdef GENN_CHECKED
+        if (i < 0 || i >= s)
+            indexError("Vector", "Length", s, i);
+#endif
+        return data[i];
+    }
+
+    const float& operator[] (int i) const {
+#ifdef GENN_CHECKED
+        if (i < 0 || i >= s)
+            indexError("Vector", "Length", s, i);
+#endif
+        return data[i];
+    }
+
+    VectorView view() { return VectorView(data, s); }
+    ConstVectorView view() const { return ConstVectorView(data, s); }
+
     Vector operator+ (const Vector& v);
     int argmax() const;
 };
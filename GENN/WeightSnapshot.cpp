@@ -0,0 +1,73 @@
+#include "pch.h"
+#include "WeightSnapshot.h"
+
+
+namespace nn {
+
+
+void WeightSnapshot::assign(const std::vector<cpu::DenseLayer>& source, const Normalization& norm, long long position, long long version) {
+    weights.assign(source);
+    layers = weights.views();
+    normalization = norm;
+    this->position = position;
+    this->version = version;
+}
+
+
+PinnedWeights& PinnedWeights::operator= (PinnedWeights&& other) {
+    if (this != &other) {
+        release();
+        snapshot = other.snapshot;
+        other.snapshot = nullptr;
+    }
+    return *this;
+}
+
+
+void PinnedWeights::release() {
+    if (snapshot != nullptr) {
+        snapshot->readers.fetch_sub(1);
+        snapshot = nullptr;
+    }
+}
+
+
+// A slot is only written while it is not the latest and has no readers. A reader that
+// pins a slot and then still finds it the latest therefore holds a complete version,
+// which the writer skips until the pin is released. All operations are sequentially
+// consistent, so a writer that saw no readers is seen to have moved latest away.
+bool WeightPublisher::publish(const std::vector<cpu::DenseLayer>& layers, const Normalization& norm, long long position) {
+    std::lock_guard<std::mutex> guard(writer);
+    int current = latest.load();
+    for (int i = 0; i < SLOTS; i++) {
+        if (i == current || slots[i].readers.load() != 0)
+            continue;
+        long long version = latestVersion.load() + 1;
+        slots[i].assign(layers, norm, position, version);
+        latest.store(i);
+        latestVersion.store(version);
+        return true;
+    }
+    return false;
+}
+
+
+PinnedWeights WeightPublisher::acquire() const {
+    while (true) {
+        int i = latest.load();
+        if (i < 0)
+            return PinnedWeights();
+        slots[i].readers.fetch_add(1);
+        if (latest.load() == i)
+            return PinnedWeights(&slots[i]);
+        slots[i].readers.fetch_sub(1);
+    }
+}
+
+
+long long WeightPublisher::version() const {
+    return latestVersion.load();
+}
+
+
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include "Dataset.h"
+#include "DenseLayer.h"
+#include "PackedWeights.h"
+
+
+namespace nn {
+
+
+// One published version of the network weights. layers are the views of the packed copy,
+// with empty gradient and activation views, so they can be handed to Evaluator::snapshot,
+// InferenceModel or QuantizedModel like the training layers.
+class WeightSnapshot {
+public:
+    std::vector<cpu::DenseLayer> layers;
+    Normalization normalization;
+    // Training samples seen when the version was taken, and its sequence number from 1
+    long long position = 0;
+    long long version = 0;
+
+private:
+    friend class WeightPublisher;
+    friend class PinnedWeights;
+
+    PackedWeights weights;
+    mutable std::atomic<int> readers{ 0 };
+
+    void assign(const std::vector<cpu::DenseLayer>& source, const Normalization& norm, long long position, long long version);
+};
+
+
+// Keeps a snapshot from being overwritten while in scope; empty before the first publish
+class PinnedWeights {
+public:
+    PinnedWeights() = default;
+    explicit PinnedWeights(const WeightSnapshot* snapshot) : snapshot(snapshot) {}
+    PinnedWeights(PinnedWeights&& other) : snapshot(other.snapshot) { other.snapshot = nullptr; }
+    PinnedWeights& operator= (PinnedWeights&& other);
+    PinnedWeights(const PinnedWeights&) = delete;
+    PinnedWeights& operator= (const PinnedWeights&) = delete;
+    ~PinnedWeights() { release(); }
+
+    explicit operator bool() const { return snapshot != nullptr; }
+    const WeightSnapshot& operator*() const { return *snapshot; }
+    const WeightSnapshot* operator->() const { return snapshot; }
+
+    void release();
+
+private:
+    const WeightSnapshot* snapshot = nullptr;
+};
+
+
+// Read-copy-update publication of weight versions in a fixed set of reusable slots. The
+// writer copies the weights into a slot that no reader pins and then makes it the latest
+// with one atomic store, so readers never see a version that is being written. Readers
+// pin the latest slot with an increment and a check, retrying only when a publish lands
+// between the two; they take no lock and never make the writer wait. The third slot lets
+// a reader keep the previous version, e.g. for a long evaluation, without blocking the
+// next publish.
+class WeightPublisher {
+public:
+    static const int SLOTS = 3;
+
+    // Copies the weights and makes them the latest version; when every other slot is still
+    // pinned it publishes nothing and returns false instead of waiting. The caller must
+    // own the layers for the duration, e.g. be the training thread. Writers are serialized.
+    bool publish(const std::vector<cpu::DenseLayer>& layers, const Normalization& norm, long long position);
+
+    // Any thread, any number of readers
+    PinnedWeights acquire() const;
+    // Sequence number of the latest version; 0 before the first publish
+    long long version() const;
+
+private:
+    WeightSnapshot slots[SLOTS];
+    std::atomic<int> latest{ -1 };
+    std::atomic<long long> latestVersion{ 0 };
+    std::mutex writer;
+};
+
+
+}
@@ -2,7 +2,10 @@
 // pch.h
 //
 
+// GENN_HEADLESS builds the portable CPU core without the UWP app, OpenCV or CUDA
+#ifndef GENN_HEADLESS
 #define CUDA
+#endif
 
 #ifdef CUDA
 #include "DenseLayer.cuh"
@@ -14,8 +17,10 @@
 
 #pragma once
 
+#ifndef GENN_HEADLESS
 #include <collection.h>
 #include <ppltasks.h>
+#endif
 #include <string>
 #include <iostream>
 #include <thread>
@@ -23,11 +28,21 @@
 #include <numeric>
 #include <algorithm>
 #include <random>
+#include <vector>
+#include <mutex>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <stdexcept>
 
+#ifdef _WIN32
 #include <windows.h>
+#endif
 
+#ifndef GENN_HEADLESS
 #include <opencv2/core/core.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/imgcodecs.hpp>
 
 #include "App.xaml.h"
+#endif
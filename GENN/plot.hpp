@@ -39,12 +39,12 @@ cv::Mat plotLoss(const std::vector<float>& loss) {
     cv::line(plot, cv::Point(20, 10), cv::Point(20, 200), cv::Scalar(180), 1, CV_AA);
     cv::line(plot, cv::Point(0, 190), cv::Point(400, 190), cv::Scalar(180), 1, CV_AA);
 
-    std::vector<float> avgLoss = wAvg(loss, 1000);
+    const std::vector<float>& avgLoss = loss;
     int n = static_cast<int>(avgLoss.size());
     if (n < 2)
         return plot;
 
-    int dn = 380 / (n - 1);
+    float dn = 380.0f / (n - 1);
     float maxLoss = static_cast<float>(*std::max_element(avgLoss.begin(), avgLoss.end()) + 0.25f);
     int dticks = static_cast<int>(180.0 / maxLoss);
 
@@ -54,7 +54,7 @@ cv::Mat plotLoss(const std::vector<float>& loss) {
     }
 
     auto transform = [&](float loss, int iter) {
-        int x = 20 + dn * iter;
+        int x = 20 + static_cast<int>(dn * iter);
         int y = 190 - static_cast<int>(loss / maxLoss * 180);
         return cv::Point(x, y);
     };
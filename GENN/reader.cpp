@@ -1,68 +1,132 @@
 #include "pch.h"
 #include "reader.h"
+#include <fstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 using namespace std;
 
-int ReverseInt(int i)
+static int readBigEndian(const uint8_t* p)
 {
-	unsigned char ch1, ch2, ch3, ch4;
-	ch1 = i & 255;
-	ch2 = (i >> 8) & 255;
-	ch3 = (i >> 16) & 255;
-	ch4 = (i >> 24) & 255;
-	return((int)ch1 << 24) + ((int)ch2 << 16) + ((int)ch3 << 8) + ch4;
+	return ((int)p[0] << 24) | ((int)p[1] << 16) | ((int)p[2] << 8) | (int)p[3];
 }
 
-void read_Mnist(std::string filename, std::vector<cpu::Matrix>& imgs) {
-	ifstream file(filename, ios::binary);
-	if (file.is_open())
-	{
-		int magic_number = 0;
-		int number_of_images = 0;
-		int n_rows = 0;
-		int n_cols = 0;
-		file.read((char*)&magic_number, sizeof(magic_number));
-		magic_number = ReverseInt(magic_number);
-		file.read((char*)&number_of_images, sizeof(number_of_images));
-		number_of_images = ReverseInt(number_of_images);
-		file.read((char*)&n_rows, sizeof(n_rows));
-		n_rows = ReverseInt(n_rows);
-		file.read((char*)&n_cols, sizeof(n_cols));
-		n_cols = ReverseInt(n_cols);
-		imgs = std::vector<cpu::Matrix>(0);
-		for (int i = 0; i < number_of_images; ++i)
-		{
-			cpu::Matrix tp(n_rows, n_cols);
-			for (int r = 0; r < n_rows; ++r)
-			{
-				for (int c = 0; c < n_cols; ++c)
-				{
-					unsigned char temp = 0;
-					file.read((char*)&temp, sizeof(temp));
-					tp.data[r * n_rows + c] = (float)temp;
-				}
-			}
-			imgs.push_back(tp);
+#ifdef _WIN32
+MappedFile::MappedFile(const string& filename)
+{
+	wstring name(MultiByteToWideChar(CP_UTF8, 0, filename.c_str(), -1, nullptr, 0), L'\0');
+	MultiByteToWideChar(CP_UTF8, 0, filename.c_str(), -1, &name[0], (int)name.size());
+	HANDLE file = CreateFile2(name.c_str(), GENERIC_READ, FILE_SHARE_READ, OPEN_EXISTING, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		throw runtime_error("Cannot open " + filename);
+
+	LARGE_INTEGER size;
+	GetFileSizeEx(file, &size);
+	length = static_cast<size_t>(size.QuadPart);
+	if (length > 0) {
+		HANDLE mapping = CreateFileMappingFromApp(file, nullptr, PAGE_READONLY, 0, nullptr);
+		if (mapping != nullptr) {
+			bytes = static_cast<const uint8_t*>(MapViewOfFileFromApp(mapping, FILE_MAP_READ, 0, 0));
+			CloseHandle(mapping);
 		}
 	}
+	CloseHandle(file);
+	if (length > 0 && bytes == nullptr)
+		throw runtime_error("Cannot map " + filename);
+}
+
+MappedFile::~MappedFile()
+{
+	if (bytes != nullptr)
+		UnmapViewOfFile(bytes);
+}
+#else
+MappedFile::MappedFile(const string& filename)
+{
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		throw runtime_error("Cannot open " + filename);
+
+	struct stat st;
+	if (fstat(fd, &st) == 0 && st.st_size > 0) {
+		length = static_cast<size_t>(st.st_size);
+		void* p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+		bytes = p == MAP_FAILED ? nullptr : static_cast<const uint8_t*>(p);
+	}
+	close(fd);
+	if (length > 0 && bytes == nullptr)
+		throw runtime_error("Cannot map " + filename);
+}
+
+MappedFile::~MappedFile()
+{
+	if (bytes != nullptr)
+		munmap(const_cast<uint8_t*>(bytes), length);
+}
+#endif
+
+size_t parseIdxHeader(const uint8_t* p, size_t fileSize, const string& filename, vector<int>& shape)
+{
+	if (fileSize < 4 || p[0] != 0 || p[1] != 0)
+		throw runtime_error(filename + " is not an IDX file");
+	if (p[2] != 0x08)
+		throw runtime_error(filename + " does not hold unsigned bytes (IDX type " + to_string(p[2]) + ")");
+
+	int n = p[3];
+	size_t header = 4 + 4 * static_cast<size_t>(n);
+	if (n == 0 || fileSize < header)
+		throw runtime_error(filename + " has a truncated IDX header");
+
+	size_t total = 1;
+	shape.clear();
+	for (int i = 0; i < n; i++) {
+		int d = readBigEndian(p + 4 + 4 * i);
+		if (d < 0 || (d > 0 && total > SIZE_MAX / d))
+			throw runtime_error(filename + " has an invalid IDX dimension " + to_string(d));
+		shape.push_back(d);
+		total *= static_cast<size_t>(d);
+	}
+	if (fileSize != header + total)
+		throw runtime_error(filename + " holds " + to_string(fileSize - header) + " payload bytes, dimensions require " + to_string(total));
+	return header;
+}
+
+IdxFile::IdxFile(const string& filename) : file(filename)
+{
+	size_t header = parseIdxHeader(file.data(), file.size(), filename, shape);
+	for (int i = 1; i < dims(); i++) {
+		stride *= shape[i];
+	}
+	payload = file.data() + header;
 }
 
-void read_Mnist_Label(string filename, std::vector<int>& vec) {
-	ifstream file(filename, ios::binary);
-	if (file.is_open()) {
-		int magic_number = 0;
-		int number_of_images = 0;
-		int n_rows = 0;
-		int n_cols = 0;
-		file.read((char*)&magic_number, sizeof(magic_number));
-		magic_number = ReverseInt(magic_number);
-		file.read((char*)&number_of_images, sizeof(number_of_images));
-		number_of_images = ReverseInt(number_of_images);
-		vec.resize(number_of_images);
-		for (int i = 0; i < number_of_images; ++i) {
-			unsigned char temp = 0;
-			file.read((char*)&temp, sizeof(temp));
-			vec[i] = (int)temp;
+vector<int> readIdxLabels(const string& filename)
+{
+	IdxFile file(filename);
+	if (file.dims() != 1)
+		throw runtime_error(filename + " is not a label file: expected 1 dimension, got " + to_string(file.dims()));
+	return vector<int>(file.data(), file.data() + file.count());
+}
+
+void writeIdx(const string& filename, const vector<int>& shape, const uint8_t* data)
+{
+	vector<uint8_t> header = { 0, 0, 0x08, static_cast<uint8_t>(shape.size()) };
+	size_t total = 1;
+	for (int d : shape) {
+		for (int shift = 24; shift >= 0; shift -= 8) {
+			header.push_back(static_cast<uint8_t>(d >> shift));
 		}
+		total *= static_cast<size_t>(d);
 	}
+
+	ofstream out(filename, ios::binary);
+	out.write(reinterpret_cast<const char*>(header.data()), header.size());
+	out.write(reinterpret_cast<const char*>(data), total);
+	if (!out)
+		throw runtime_error("Cannot write " + filename);
 }
@@ -1,10 +1,57 @@
 #pragma once
 
-#include <vector>
+#include <cstdint>
 #include <string>
-#include <fstream>
+#include <vector>
+
+
+// Validates an IDX header of unsigned bytes against the file size and returns its
+// length; p must hold the first min(fileSize, 1024) bytes of the file
+size_t parseIdxHeader(const uint8_t* p, size_t fileSize, const std::string& filename, std::vector<int>& shape);
+
+
+// Read-only mapping of a whole file
+class MappedFile
+{
+public:
+	explicit MappedFile(const std::string& filename);
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator= (const MappedFile&) = delete;
+	~MappedFile();
+
+	const uint8_t* data() const { return bytes; }
+	size_t size() const { return length; }
+
+private:
+	const uint8_t* bytes = nullptr;
+	size_t length = 0;
+};
+
+
+// IDX file of unsigned bytes: magic 0x0000080N, N big-endian int32 dimensions, then the
+// payload, which is served in place from the mapping
+class IdxFile
+{
+public:
+	explicit IdxFile(const std::string& filename);
+
+	int dims() const { return static_cast<int>(shape.size()); }
+	int dim(int i) const { return shape[i]; }
+	int count() const { return shape[0]; }
+	int itemSize() const { return stride; }
+
+	const uint8_t* data() const { return payload; }
+	const uint8_t* item(int i) const { return payload + static_cast<size_t>(i) * stride; }
+
+private:
+	MappedFile file;
+	std::vector<int> shape;
+	int stride = 1;
+	const uint8_t* payload = nullptr;
+};
+
 
-#include "Matrix.h"
+std::vector<int> readIdxLabels(const std::string& filename);
 
-void read_Mnist(std::string filename, std::vector<cpu::Matrix> &imgs);
-void read_Mnist_Label(std::string filename, std::vector<int> &vec);
+// Writes unsigned bytes of the given dimensions as an IDX file
+void writeIdx(const std::string& filename, const std::vector<int>& shape, const uint8_t* data);
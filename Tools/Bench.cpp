@@ -0,0 +1,489 @@
+#include "pch.h"
+#include "NN.h"
+#include "Gemm.h"
+#include "Simd.h"
+#include "FastMath.h"
+#include "Benchmark.h"
+#include "Synthetic.h"
+#include <cstdio>
+
+
+// Benchmark suite for the CPU core. Items are floating-point operations for the matrix
+// products, samples for the layers and the network, and parameters for the optimizer
+// steps. The network benchmarks run on synthetic MNIST-sized IDX files that are written
+// to --data DIR (default genn-bench-data) on first use; --simd LEVEL caps the kernels and
+// --fast-math turns the fast-math kernels on. --check-math compares the fast-math
+// kernels with libm at every SIMD level instead of benchmarking. The remaining options
+// are those of tools::runBenchmarks.
+
+using tools::BenchmarkState;
+using tools::registerBenchmark;
+
+
+static const int TRAIN_IMAGES = 60000;
+static const int TEST_IMAGES = 10000;
+// Below the 10000-sample evaluation interval, so network/train measures training alone
+static const int TRAIN_CHUNK = 5000;
+
+static std::string dataDirectory = "genn-bench-data";
+
+
+struct Data {
+    tools::MnistFiles files;
+    nn::ImageSet images;
+    std::vector<int> labels;
+    nn::ImageSet testImages;
+    std::vector<int> testLabels;
+
+    Data() : files(tools::writeSyntheticMnist(dataDirectory, TRAIN_IMAGES, TEST_IMAGES, 1)),
+        images(std::make_shared<const IdxFile>(files.trainImages)),
+        labels(readIdxLabels(files.trainLabels)),
+        testImages(std::make_shared<const IdxFile>(files.testImages)),
+        testLabels(readIdxLabels(files.testLabels)) {
+    }
+};
+
+
+static const Data& data() {
+    static Data d;
+    return d;
+}
+
+
+static void fill(float* x, size_t n, std::mt19937& gen) {
+    std::uniform_real_distribution<float> d(-1.0f, 1.0f);
+    for (size_t i = 0; i < n; i++) {
+        x[i] = d(gen);
+    }
+}
+
+
+// A standalone sigmoid layer with its own parameters and batch buffers
+struct LayerFixture {
+    cpu::DenseLayer layer;
+    cpu::Arena arena;
+    std::vector<float> delta;
+
+    LayerFixture(int in, int out, int batch) : layer(in, out, cpu::Activation::sigmoid),
+        arena(layer.parameterSize() + 2 * cpu::Arena::padded(batch * in) + 2 * cpu::Arena::padded(batch * out)),
+        delta(static_cast<size_t>(batch) * out) {
+        layer.bindParameters(arena);
+        cpu::MatrixView x(arena.allocate(batch * in), batch, in);
+        cpu::MatrixView dx(arena.allocate(batch * in), batch, in);
+        cpu::MatrixView y(arena.allocate(batch * out), batch, out);
+        cpu::MatrixView dy(arena.allocate(batch * out), batch, out);
+        layer.bindActivations(x, dx, y, dy);
+        layer.setBatchSize(batch);
+
+        std::mt19937 gen{ 1 };
+        layer.initParameters(gen);
+        fill(x.data, static_cast<size_t>(batch) * in, gen);
+        fill(delta.data(), delta.size(), gen);
+        layer.forwardBatch();
+    }
+
+    // backward scales the output gradient in place, so every call starts from a copy
+    void resetDelta() {
+        memcpy(layer.batchDOutput.data, delta.data(), delta.size() * sizeof(float));
+    }
+};
+
+
+static std::vector<cpu::DenseLayer> mnistLayers(cpu::Arena& arena) {
+    std::vector<cpu::DenseLayer> layers = {
+        cpu::DenseLayer(784, 64, cpu::Activation::sigmoid),
+        cpu::DenseLayer(64, 64, cpu::Activation::sigmoid),
+        cpu::DenseLayer(64, 10, cpu::Activation::linear, true)
+    };
+    size_t size = 0;
+    for (auto& layer : layers) {
+        size += layer.parameterSize();
+    }
+    arena = cpu::Arena(size);
+    std::mt19937 gen{ 1 };
+    for (auto& layer : layers) {
+        layer.bindParameters(arena);
+        layer.initParameters(gen);
+    }
+    return layers;
+}
+
+
+static void registerMatrixBenchmarks() {
+    for (int n : { 64, 256 }) {
+        registerBenchmark("matrix_mul/" + std::to_string(n), [n](BenchmarkState& state) {
+            std::mt19937 gen{ 1 };
+            cpu::Matrix a(n, n);
+            cpu::Matrix b(n, n);
+            fill(a.data, static_cast<size_t>(n) * n, gen);
+            fill(b.data, static_cast<size_t>(n) * n, gen);
+            while (state.keepRunning()) {
+                cpu::Matrix c = a.mul(b);
+            }
+            state.setItemsProcessed(2.0 * n * n * n * state.iterations());
+        });
+    }
+
+    // The products of one 784-64 layer on a minibatch of 50
+    struct Shape { const char* name; bool transB; int M; int N; int K; };
+    for (Shape s : { Shape{ "forward", true, 50, 64, 784 }, Shape{ "input_gradient", false, 50, 784, 64 }, Shape{ "weight_gradient", false, 64, 784, 50 } }) {
+        std::string name = std::string("sgemm/") + s.name + "/" + std::to_string(s.M) + "x" + std::to_string(s.N) + "x" + std::to_string(s.K);
+        registerBenchmark(name, [s](BenchmarkState& state) {
+            std::mt19937 gen{ 1 };
+            std::vector<float> a(static_cast<size_t>(s.M) * s.K), b(static_cast<size_t>(s.K) * s.N), c(static_cast<size_t>(s.M) * s.N);
+            fill(a.data(), a.size(), gen);
+            fill(b.data(), b.size(), gen);
+            while (state.keepRunning()) {
+                cpu::sgemm(false, s.transB, s.M, s.N, s.K, 1.0f, a.data(), s.K, b.data(), s.transB ? s.K : s.N, 0.0f, c.data(), s.N);
+            }
+            state.setItemsProcessed(2.0 * s.M * s.N * s.K * state.iterations());
+        });
+    }
+}
+
+
+static void registerLayerBenchmarks() {
+    registerBenchmark("dense/forward/784x64", [](BenchmarkState& state) {
+        LayerFixture f(784, 64, 1);
+        while (state.keepRunning()) {
+            f.layer.forward();
+        }
+        state.setItemsProcessed(static_cast<double>(state.iterations()));
+    });
+    registerBenchmark("dense/backward/784x64", [](BenchmarkState& state) {
+        LayerFixture f(784, 64, 1);
+        while (state.keepRunning()) {
+            f.resetDelta();
+            f.layer.backward();
+        }
+        state.setItemsProcessed(static_cast<double>(state.iterations()));
+    });
+    registerBenchmark("dense/forward_batch/784x64/50", [](BenchmarkState& state) {
+        LayerFixture f(784, 64, 50);
+        while (state.keepRunning()) {
+            f.layer.forwardBatch();
+        }
+        state.setItemsProcessed(50.0 * state.iterations());
+    });
+    registerBenchmark("dense/backward_batch/784x64/50", [](BenchmarkState& state) {
+        LayerFixture f(784, 64, 50);
+        while (state.keepRunning()) {
+            f.resetDelta();
+            f.layer.backwardBatch();
+        }
+        state.setItemsProcessed(50.0 * state.iterations());
+    });
+
+    // Bias, activation and derivative over the 50x64 outputs of a hidden layer
+    for (int a = 0; a <= static_cast<int>(cpu::Activation::tanh); a++) {
+        cpu::Activation act = static_cast<cpu::Activation>(a);
+        registerBenchmark(std::string("activation/") + cpu::activationName(act) + "/50x64", [act](BenchmarkState& state) {
+            const int rows = 50;
+            const int n = 64;
+            std::mt19937 gen{ 1 };
+            std::vector<float> z(rows * n), y(rows * n), d(rows * n), bias(n);
+            fill(z.data(), z.size(), gen);
+            fill(bias.data(), bias.size(), gen);
+            while (state.keepRunning()) {
+                y = z;
+                for (int r = 0; r < rows; r++) {
+                    cpu::activate(act, y.data() + r * n, bias.data(), n);
+                }
+                std::fill(d.begin(), d.end(), 1.0f);
+                cpu::gradActivation(act, z.data(), y.data(), d.data(), rows * n);
+            }
+            state.setItemsProcessed(static_cast<double>(rows) * n * state.iterations());
+        });
+    }
+
+    // The update that DenseLayer::step used to do, now one fused optimizer pass
+    registerBenchmark("optimizer_step/sgd", [](BenchmarkState& state) {
+        cpu::Arena arena;
+        std::vector<cpu::DenseLayer> layers = mnistLayers(arena);
+        cpu::Sgd sgd(1e-6f);
+        size_t parameters = 0;
+        for (auto& layer : layers) {
+            parameters += static_cast<size_t>(layer.outSize) * (layer.inSize + 1);
+        }
+        while (state.keepRunning()) {
+            sgd.step(layers);
+        }
+        state.setItemsProcessed(static_cast<double>(parameters) * state.iterations());
+    });
+    registerBenchmark("optimizer_step/adam", [](BenchmarkState& state) {
+        cpu::Arena arena;
+        std::vector<cpu::DenseLayer> layers = mnistLayers(arena);
+        cpu::Adam adam(1e-6f);
+        adam.reserve(layers);
+        size_t parameters = 0;
+        for (auto& layer : layers) {
+            parameters += static_cast<size_t>(layer.outSize) * (layer.inSize + 1);
+        }
+        while (state.keepRunning()) {
+            adam.step(layers);
+        }
+        state.setItemsProcessed(static_cast<double>(parameters) * state.iterations());
+    });
+
+    // The copy the trainer makes every publishInterval steps, and a reader's pin and unpin
+    registerBenchmark("weights/publish", [](BenchmarkState& state) {
+        cpu::Arena arena;
+        std::vector<cpu::DenseLayer> layers = mnistLayers(arena);
+        nn::WeightPublisher publisher;
+        while (state.keepRunning()) {
+            publisher.publish(layers, nn::Normalization(), 0);
+        }
+        state.setBytesProcessed(static_cast<double>(arena.capacity()) * sizeof(float) * state.iterations());
+    });
+    registerBenchmark("weights/acquire", [](BenchmarkState& state) {
+        cpu::Arena arena;
+        std::vector<cpu::DenseLayer> layers = mnistLayers(arena);
+        nn::WeightPublisher publisher;
+        publisher.publish(layers, nn::Normalization(), 0);
+        while (state.keepRunning()) {
+            nn::PinnedWeights w = publisher.acquire();
+        }
+        state.setItemsProcessed(static_cast<double>(state.iterations()));
+    });
+}
+
+
+// One iteration runs Network::train on its own thread until TRAIN_CHUNK samples are done
+static void trainChunks(BenchmarkState& state, int threads, cpu::Precision precision, const std::string& layers = "") {
+    const Data& d = data();
+    nn::Network net;
+    if (!layers.empty()) {
+        net.topology = nn::parseTopology(layers);
+        net.learningRate = 0.0003f;
+    }
+    net.threads = threads;
+    net.seed = 1;
+    net.precision = precision;
+    net.setTrainData(d.images, d.labels);
+    net.setTestData(d.testImages, d.testLabels);
+    double samples = 0;
+    while (state.keepRunning()) {
+        net.telemetry.reset(d.images.size());
+        std::thread trainer(&nn::Network::startTraining, &net);
+        while (net.getPosition() < TRAIN_CHUNK) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        net.stopTraining();
+        trainer.join();
+        samples += net.getPosition();
+    }
+    state.setItemsProcessed(samples);
+}
+
+
+static void registerNetworkBenchmarks() {
+    std::vector<int> threadCounts = { 1 };
+    int hardware = static_cast<int>(std::thread::hardware_concurrency());
+    if (hardware > 1) {
+        threadCounts.push_back(hardware);
+    }
+    for (int t : threadCounts) {
+        registerBenchmark("network/train/threads:" + std::to_string(t), [t](BenchmarkState& state) {
+            trainChunks(state, t, cpu::Precision::fp32);
+        });
+    }
+    registerBenchmark("network/train_bf16/threads:1", [](BenchmarkState& state) {
+        trainChunks(state, 1, cpu::Precision::bf16);
+    });
+    registerBenchmark("network/train_relu/threads:1", [](BenchmarkState& state) {
+        trainChunks(state, 1, cpu::Precision::fp32, "64:relu,64:relu,10");
+    });
+    registerBenchmark("network/test", [](BenchmarkState& state) {
+        const Data& d = data();
+        nn::Network net;
+        net.setTrainData(d.images, d.labels);
+        net.setTestData(d.testImages, d.testLabels);
+        while (state.keepRunning()) {
+            net.test(d.testImages.size());
+        }
+        state.setItemsProcessed(static_cast<double>(d.testImages.size()) * state.iterations());
+    });
+    // test() on the published weights while a trainer thread keeps publishing new ones
+    registerBenchmark("network/test_while_training", [](BenchmarkState& state) {
+        const Data& d = data();
+        nn::Network net;
+        net.seed = 1;
+        net.setTrainData(d.images, d.labels);
+        net.setTestData(d.testImages, d.testLabels);
+        std::thread trainer(&nn::Network::startTraining, &net);
+        while (net.getPosition() == 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        while (state.keepRunning()) {
+            net.test(d.testImages.size());
+        }
+        net.stopTraining();
+        trainer.join();
+        state.setItemsProcessed(static_cast<double>(d.testImages.size()) * state.iterations());
+    });
+
+    // Maps and parses the IDX files and normalizes every image, from the page cache
+    registerBenchmark("idx/load", [](BenchmarkState& state) {
+        const tools::MnistFiles& files = data().files;
+        const int chunk = 256;
+        cpu::Matrix x(chunk, 784);
+        double images = 0;
+        double bytes = 0;
+        while (state.keepRunning()) {
+            auto file = std::make_shared<const IdxFile>(files.trainImages);
+            nn::ImageSet set(file);
+            std::vector<int> labels = readIdxLabels(files.trainLabels);
+            for (int i = 0; i < set.size(); i += chunk) {
+                int n = std::min(chunk, set.size() - i);
+                set.normalize(i, n, nn::Normalization(), x.view().rows(0, n));
+            }
+            images += set.size();
+            bytes += static_cast<double>(set.size()) * set.pixels() + labels.size();
+        }
+        state.setItemsProcessed(images);
+        state.setBytesProcessed(bytes);
+    });
+}
+
+
+static const char* simdName(cpu::simd::Level level) {
+    switch (level) {
+    case cpu::simd::avx512:
+        return "avx512";
+    case cpu::simd::avx2:
+        return "avx2";
+    default:
+        return "scalar";
+    }
+}
+
+
+// Every MATH_STRIDE-th float is checked
+static const uint32_t MATH_STRIDE = 64;
+
+
+struct MathCheck {
+    const char* name;
+    void (*kernel)(const float* x, float* y, int n);
+    double (*reference)(double x);
+    bool (*inDomain)(float x);
+    double bound;
+};
+
+
+static double sigmoidReference(double x) {
+    return 1.0 / (1.0 + std::exp(-x));
+}
+
+
+static double ulpOf(double r) {
+    int e;
+    std::frexp(r, &e);
+    return std::ldexp(1.0, std::max(e - 24, -149));
+}
+
+
+// Largest error in units in the last place of the float result over the kernel's domain,
+// plus the special values; returns the number of kernels above their documented bound
+static int checkMath(cpu::simd::Level level) {
+    MathCheck checks[] = {
+        { "exp", cpu::fastmath::exp, [](double x) { return std::exp(x); }, [](float x) { return x >= -87.3f && x <= 88.7f; }, 2.0 },
+        { "log", cpu::fastmath::log, [](double x) { return std::log(x); }, [](float x) { return x > 0.0f && x < INFINITY; }, 2.0 },
+        { "sigmoid", cpu::fastmath::sigmoid, sigmoidReference, [](float x) { return std::isfinite(x) && sigmoidReference(x) >= 1e-30; }, 3.0 },
+        { "tanh", cpu::fastmath::tanh, [](double x) { return std::tanh(x); }, [](float x) { return std::isfinite(x); }, 2.0 }
+    };
+    int failures = 0;
+    std::vector<float> x;
+    std::vector<float> y;
+    for (auto& c : checks) {
+        x.clear();
+        for (uint64_t b = 0; b <= 0xffffffffull; b += MATH_STRIDE) {
+            uint32_t bits = static_cast<uint32_t>(b);
+            float v;
+            memcpy(&v, &bits, sizeof(v));
+            if (c.inDomain(v)) {
+                x.push_back(v);
+            }
+        }
+        y.resize(x.size());
+        c.kernel(x.data(), y.data(), static_cast<int>(x.size()));
+        double worst = 0;
+        float worstX = 0;
+        for (size_t i = 0; i < x.size(); i++) {
+            double r = c.reference(x[i]);
+            double e = std::fabs(y[i] - r) / ulpOf(r);
+            if (!(e <= worst)) {
+                worst = e;
+                worstX = x[i];
+            }
+        }
+
+        float special[] = { NAN, INFINITY, -INFINITY, 0.0f, -0.0f, 200.0f, -200.0f, -1.0f };
+        float out[8];
+        c.kernel(special, out, 8);
+        bool specials = std::isnan(out[0]) && std::equal(out + 1, out + 8, special + 1, [&](float got, float in) {
+            double r = c.reference(in);
+            return std::isnan(r) ? std::isnan(got) : got == static_cast<float>(r);
+        });
+
+        bool ok = worst <= c.bound && specials;
+        failures += ok ? 0 : 1;
+        printf("%-8s %-7s %10zu inputs  max error %6.2f ulp at %-14.7g bound %.0f ulp  specials %s%s\n", simdName(level), c.name,
+            x.size(), worst, worstX, c.bound, specials ? "ok" : "WRONG", ok ? "" : "  FAILED");
+        fflush(stdout);
+    }
+    return failures;
+}
+
+
+int main(int argc, char** argv) {
+    std::vector<char*> args = { argv[0] };
+    bool mathCheck = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--check-math") {
+            mathCheck = true;
+        }
+        else if (arg == "--fast-math") {
+            cpu::fastmath::setEnabled(true);
+        }
+        else if (arg == "--data" && i + 1 < argc) {
+            dataDirectory = argv[++i];
+        }
+        else if (arg == "--simd" && i + 1 < argc) {
+            std::string level = argv[++i];
+            cpu::simd::setLevel(level == "avx512" ? cpu::simd::avx512 : level == "avx2" ? cpu::simd::avx2 : cpu::simd::scalar);
+        }
+        else {
+            args.push_back(argv[i]);
+        }
+    }
+
+    if (mathCheck) {
+        int failures = 0;
+        cpu::simd::Level top = cpu::simd::level();
+        for (int l = cpu::simd::scalar; l <= top; l++) {
+            cpu::simd::setLevel(static_cast<cpu::simd::Level>(l));
+            failures += checkMath(cpu::simd::level());
+        }
+        return failures == 0 ? 0 : 1;
+    }
+
+    registerMatrixBenchmarks();
+    registerLayerBenchmarks();
+    registerNetworkBenchmarks();
+
+    std::vector<std::pair<std::string, std::string>> context = {
+        { "simd", simdName(cpu::simd::level()) },
+        { "vnni", cpu::simd::vnni() ? "yes" : "no" },
+        { "avx512_bf16", cpu::simd::bf16() ? "yes" : "no" },
+        { "fast_math", cpu::fastmath::enabled() ? "yes" : "no" }
+    };
+    try {
+        return tools::runBenchmarks(static_cast<int>(args.size()), args.data(), context);
+    }
+    catch (const std::exception& e) {
+        fprintf(stderr, "genn-bench: %s\n", e.what());
+        return 1;
+    }
+}
@@ -0,0 +1,328 @@
+#include "pch.h"
+#include "Benchmark.h"
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <map>
+#include <regex>
+#include <sstream>
+
+
+namespace tools {
+
+
+static const long long MAX_ITERATIONS = 1000000000;
+
+
+static const char* USAGE =
+    "usage: genn-bench [options]\n"
+    "  --filter REGEX     run only the benchmarks whose name matches\n"
+    "  --list             print the benchmark names and exit\n"
+    "  --min-time S       minimum measured seconds per benchmark (default 0.5)\n"
+    "  --repetitions N    repeat every benchmark and report the median (default 1)\n"
+    "  --json             print the report as JSON\n"
+    "  --out FILE         also write the JSON report to FILE\n"
+    "  --baseline FILE    compare with an earlier JSON report; exit 1 on regressions\n"
+    "  --tolerance X      allowed relative throughput loss against the baseline (default 0.1)\n";
+
+
+static double realNow() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+static double cpuNow() {
+    return static_cast<double>(std::clock()) / CLOCKS_PER_SEC;
+}
+
+
+bool BenchmarkState::keepRunning() {
+    if (done == 0 && !running) {
+        resumeTiming();
+    }
+    if (done < n) {
+        done++;
+        return true;
+    }
+    pauseTiming();
+    return false;
+}
+
+
+void BenchmarkState::pauseTiming() {
+    if (!running)
+        return;
+    real += realNow() - realStart;
+    cpu += cpuNow() - cpuStart;
+    running = false;
+}
+
+
+void BenchmarkState::resumeTiming() {
+    if (running)
+        return;
+    realStart = realNow();
+    cpuStart = cpuNow();
+    running = true;
+}
+
+
+static std::vector<std::pair<std::string, BenchmarkFunction>>& registry() {
+    static std::vector<std::pair<std::string, BenchmarkFunction>> benchmarks;
+    return benchmarks;
+}
+
+
+void registerBenchmark(const std::string& name, BenchmarkFunction body) {
+    registry().emplace_back(name, std::move(body));
+}
+
+
+// Grows the iteration count until one run lasts minTime, as Google Benchmark does
+static BenchmarkResult measure(const std::string& name, const BenchmarkFunction& body, double minTime) {
+    long long n = 1;
+    while (true) {
+        BenchmarkState state(n);
+        body(state);
+        double seconds = state.realSeconds();
+        if (seconds >= minTime || n >= MAX_ITERATIONS) {
+            BenchmarkResult r;
+            r.name = name;
+            r.iterations = n;
+            r.realNs = seconds * 1e9 / n;
+            r.cpuNs = state.cpuSeconds() * 1e9 / n;
+            r.itemsPerSecond = seconds > 0 ? state.items() / seconds : 0;
+            r.bytesPerSecond = seconds > 0 ? state.bytes() / seconds : 0;
+            return r;
+        }
+        double multiplier = seconds > minTime / 100 ? 1.4 * minTime / seconds : 10.0;
+        n = std::min(MAX_ITERATIONS, std::max(n + 1, static_cast<long long>(n * std::min(multiplier, 10.0))));
+    }
+}
+
+
+static std::string escape(const std::string& s) {
+    std::string r;
+    for (char c : s) {
+        if (c == '"' || c == '\\')
+            r += '\\';
+        r += c;
+    }
+    return r;
+}
+
+
+static std::string toJson(const std::vector<BenchmarkResult>& results, int repetitions,
+    const std::vector<std::pair<std::string, std::string>>& context) {
+    char date[64];
+    std::time_t now = std::time(nullptr);
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+
+    std::ostringstream out;
+    out << "{\n  \"context\": {\n";
+    out << "    \"date\": \"" << date << "\",\n";
+    out << "    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n";
+    for (auto& kv : context) {
+        out << "    \"" << escape(kv.first) << "\": \"" << escape(kv.second) << "\",\n";
+    }
+#ifdef NDEBUG
+    out << "    \"library_build_type\": \"release\"\n";
+#else
+    out << "    \"library_build_type\": \"debug\"\n";
+#endif
+    out << "  },\n  \"benchmarks\": [\n";
+    char line[1024];
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchmarkResult& r = results[i];
+        std::string name = escape(r.name);
+        int n = snprintf(line, sizeof(line),
+            "    {\"name\": \"%s\", \"run_name\": \"%s\", \"run_type\": \"iteration\", \"repetitions\": %d, "
+            "\"iterations\": %lld, \"real_time\": %.6g, \"cpu_time\": %.6g, \"time_unit\": \"ns\"",
+            name.c_str(), name.c_str(), repetitions, r.iterations, r.realNs, r.cpuNs);
+        if (r.itemsPerSecond > 0) {
+            n += snprintf(line + n, sizeof(line) - n, ", \"items_per_second\": %.6g", r.itemsPerSecond);
+        }
+        if (r.bytesPerSecond > 0) {
+            n += snprintf(line + n, sizeof(line) - n, ", \"bytes_per_second\": %.6g", r.bytesPerSecond);
+        }
+        out << line << (i + 1 < results.size() ? "},\n" : "}\n");
+    }
+    out << "  ]\n}\n";
+    return out.str();
+}
+
+
+static std::string human(double v, const char* unit) {
+    const char* prefixes[] = { "", "k", "M", "G", "T" };
+    int p = 0;
+    while (v >= 1000 && p < 4) {
+        v /= 1000;
+        p++;
+    }
+    char s[64];
+    snprintf(s, sizeof(s), "%.3g %s%s/s", v, prefixes[p], unit);
+    return s;
+}
+
+
+static void printRow(const BenchmarkResult& r) {
+    std::string throughput;
+    if (r.itemsPerSecond > 0)
+        throughput = human(r.itemsPerSecond, "items");
+    if (r.bytesPerSecond > 0)
+        throughput += (throughput.empty() ? "" : "  ") + human(r.bytesPerSecond, "B");
+    printf("%-40s %14.0f %14.0f %12lld  %s\n", r.name.c_str(), r.realNs, r.cpuNs, r.iterations, throughput.c_str());
+    fflush(stdout);
+}
+
+
+static double numberAfter(const std::string& line, const std::string& key) {
+    size_t p = line.find("\"" + key + "\":");
+    return p == std::string::npos ? 0 : atof(line.c_str() + p + key.size() + 3);
+}
+
+
+// Reads the benchmark lines of a report written by toJson, one object per line
+static std::map<std::string, BenchmarkResult> readReport(const std::string& filename) {
+    std::ifstream in(filename);
+    if (!in)
+        throw std::runtime_error("Cannot open " + filename);
+    std::map<std::string, BenchmarkResult> results;
+    std::string line;
+    const std::string key = "{\"name\": \"";
+    while (std::getline(in, line)) {
+        size_t p = line.find(key);
+        if (p == std::string::npos)
+            continue;
+        size_t end = line.find('"', p + key.size());
+        BenchmarkResult r;
+        r.name = line.substr(p + key.size(), end - p - key.size());
+        r.realNs = numberAfter(line, "real_time");
+        r.itemsPerSecond = numberAfter(line, "items_per_second");
+        results[r.name] = r;
+    }
+    return results;
+}
+
+
+// Throughput relative to the baseline: items per second where both report them, else
+// inverse time
+static double speedup(const BenchmarkResult& base, const BenchmarkResult& r) {
+    if (base.itemsPerSecond > 0 && r.itemsPerSecond > 0)
+        return r.itemsPerSecond / base.itemsPerSecond;
+    return r.realNs > 0 ? base.realNs / r.realNs : 0;
+}
+
+
+static int compare(const std::vector<BenchmarkResult>& results, const std::string& filename, double tolerance) {
+    std::map<std::string, BenchmarkResult> baseline = readReport(filename);
+    int regressions = 0;
+    fprintf(stderr, "\nComparison with %s (tolerance %.0f%%)\n", filename.c_str(), tolerance * 100);
+    for (auto& r : results) {
+        auto it = baseline.find(r.name);
+        if (it == baseline.end()) {
+            fprintf(stderr, "%-40s %10s\n", r.name.c_str(), "new");
+            continue;
+        }
+        double s = speedup(it->second, r);
+        bool regressed = s < 1.0 - tolerance;
+        regressions += regressed ? 1 : 0;
+        fprintf(stderr, "%-40s %+9.1f%%%s\n", r.name.c_str(), (s - 1.0) * 100, regressed ? "  REGRESSION" : "");
+    }
+    return regressions == 0 ? 0 : 1;
+}
+
+
+int runBenchmarks(int argc, char** argv, const std::vector<std::pair<std::string, std::string>>& context) {
+    std::string filter;
+    std::string out;
+    std::string baseline;
+    double minTime = 0.5;
+    double tolerance = 0.1;
+    int repetitions = 1;
+    bool json = false;
+    bool list = false;
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            if (arg == "--json") {
+                json = true;
+                continue;
+            }
+            if (arg == "--list") {
+                list = true;
+                continue;
+            }
+            if (arg == "--help" || arg == "-h")
+                throw std::invalid_argument("");
+            if (i + 1 >= argc)
+                throw std::invalid_argument("missing value for " + arg);
+            std::string v = argv[++i];
+            if (arg == "--filter") filter = v;
+            else if (arg == "--min-time") minTime = std::stod(v);
+            else if (arg == "--repetitions") repetitions = std::max(1, std::stoi(v));
+            else if (arg == "--out") out = v;
+            else if (arg == "--baseline") baseline = v;
+            else if (arg == "--tolerance") tolerance = std::stod(v);
+            else throw std::invalid_argument("unknown option " + arg);
+        }
+    }
+    catch (const std::exception& e) {
+        if (e.what()[0] != '\0')
+            fprintf(stderr, "genn-bench: %s\n", e.what());
+        fputs(USAGE, stderr);
+        return 2;
+    }
+
+    std::regex pattern(filter.empty() ? ".*" : filter);
+    if (!json && !list) {
+        for (auto& kv : context) {
+            printf("%s: %s\n", kv.first.c_str(), kv.second.c_str());
+        }
+        printf("%-40s %14s %14s %12s  %s\n", "Benchmark", "Time (ns)", "CPU (ns)", "Iterations", "Throughput");
+    }
+
+    std::vector<BenchmarkResult> results;
+    try {
+        for (auto& b : registry()) {
+            if (!std::regex_search(b.first, pattern))
+                continue;
+            if (list) {
+                printf("%s\n", b.first.c_str());
+                continue;
+            }
+            std::vector<BenchmarkResult> runs;
+            for (int r = 0; r < repetitions; r++) {
+                runs.push_back(measure(b.first, b.second, minTime));
+            }
+            std::sort(runs.begin(), runs.end(), [](const BenchmarkResult& x, const BenchmarkResult& y) { return x.realNs < y.realNs; });
+            results.push_back(runs[runs.size() / 2]);
+            if (!json) {
+                printRow(results.back());
+            }
+        }
+    }
+    catch (const std::exception& e) {
+        fprintf(stderr, "genn-bench: %s\n", e.what());
+        return 1;
+    }
+    if (list)
+        return 0;
+
+    std::string report = toJson(results, repetitions, context);
+    if (json) {
+        fputs(report.c_str(), stdout);
+    }
+    if (!out.empty()) {
+        std::ofstream file(out);
+        file << report;
+        if (!file) {
+            fprintf(stderr, "genn-bench: cannot write %s\n", out.c_str());
+            return 1;
+        }
+    }
+    return baseline.empty() ? 0 : compare(results, baseline, tolerance);
+}
+
+
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+namespace tools {
+
+
+// Timing loop handed to a benchmark body, in the manner of Google Benchmark:
+//
+//     while (state.keepRunning()) { work(); }
+//     state.setItemsProcessed(state.iterations() * itemsPerCall);
+//
+// The clock starts at the first keepRunning() call and stops after the last iteration;
+// setup before the loop is not timed.
+class BenchmarkState {
+public:
+    explicit BenchmarkState(long long iterations) : n(iterations) {}
+
+    long long iterations() const { return n; }
+    bool keepRunning();
+
+    void pauseTiming();
+    void resumeTiming();
+
+    void setItemsProcessed(double items) { itemCount = items; }
+    void setBytesProcessed(double bytes) { byteCount = bytes; }
+
+    double realSeconds() const { return real; }
+    double cpuSeconds() const { return cpu; }
+    double items() const { return itemCount; }
+    double bytes() const { return byteCount; }
+
+private:
+    long long n;
+    long long done = 0;
+    bool running = false;
+    double realStart = 0;
+    double cpuStart = 0;
+    double real = 0;
+    double cpu = 0;
+    double itemCount = 0;
+    double byteCount = 0;
+};
+
+
+typedef std::function<void(BenchmarkState&)> BenchmarkFunction;
+
+void registerBenchmark(const std::string& name, BenchmarkFunction body);
+
+
+struct BenchmarkResult {
+    std::string name;
+    long long iterations = 0;
+    double realNs = 0;
+    double cpuNs = 0;
+    double itemsPerSecond = 0;
+    double bytesPerSecond = 0;
+};
+
+
+// Runs the registered benchmarks and reports them on stdout as a table, or as Google
+// Benchmark compatible JSON with --json. --out FILE also writes the JSON to FILE;
+// --baseline FILE compares against an earlier JSON report and fails when a benchmark
+// lost more than --tolerance (default 0.1) of its throughput. context adds key/value
+// pairs to the report header. Returns the exit code.
+int runBenchmarks(int argc, char** argv, const std::vector<std::pair<std::string, std::string>>& context);
+
+
+}
@@ -0,0 +1,73 @@
+#include "pch.h"
+#include "Synthetic.h"
+#include "reader.h"
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+
+namespace tools {
+
+
+static const int SIDE = 28;
+static const int CLASSES = 10;
+
+
+MnistFiles::MnistFiles(const std::string& directory) :
+    trainImages(directory + "/train-images.idx3-ubyte"),
+    trainLabels(directory + "/train-labels.idx1-ubyte"),
+    testImages(directory + "/t10k-images.idx3-ubyte"),
+    testLabels(directory + "/t10k-labels.idx1-ubyte") {
+}
+
+
+static void makeDirectory(const std::string& directory) {
+#ifdef _WIN32
+    _mkdir(directory.c_str());
+#else
+    mkdir(directory.c_str(), 0755);
+#endif
+}
+
+
+static void writeSplit(const std::string& images, const std::string& labels, int n,
+    const std::vector<uint8_t>& templates, std::mt19937& gen) {
+    const int pixels = SIDE * SIDE;
+    std::vector<uint8_t> x(static_cast<size_t>(n) * pixels);
+    std::vector<uint8_t> y(n);
+    for (int i = 0; i < n; i++) {
+        int label = static_cast<int>(gen() % CLASSES);
+        const uint8_t* t = &templates[static_cast<size_t>(label) * pixels];
+        uint8_t* dst = &x[static_cast<size_t>(i) * pixels];
+        for (int j = 0; j < pixels; j++) {
+            int v = 64 + t[j] / 2 + static_cast<int>(gen() % 256) - 128;
+            dst[j] = static_cast<uint8_t>(std::min(255, std::max(0, v)));
+        }
+        y[i] = static_cast<uint8_t>(label);
+    }
+    writeIdx(images, { n, SIDE, SIDE }, x.data());
+    writeIdx(labels, { n }, y.data());
+}
+
+
+MnistFiles writeSyntheticMnist(const std::string& directory, int trainCount, int testCount, unsigned seed) {
+    if (trainCount <= 0 || testCount <= 0)
+        throw std::runtime_error("Synthetic data needs at least one training and one test image");
+    makeDirectory(directory);
+
+    std::mt19937 gen{ seed };
+    std::vector<uint8_t> templates(CLASSES * SIDE * SIDE);
+    for (auto& p : templates) {
+        p = static_cast<uint8_t>(gen() % 256);
+    }
+    MnistFiles files(directory);
+    writeSplit(files.trainImages, files.trainLabels, trainCount, templates, gen);
+    writeSplit(files.testImages, files.testLabels, testCount, templates, gen);
+    return files;
+}
+
+
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+
+
+namespace tools {
+
+
+// File names of the four MNIST IDX files inside a directory
+struct MnistFiles {
+    std::string trainImages;
+    std::string trainLabels;
+    std::string testImages;
+    std::string testLabels;
+
+    explicit MnistFiles(const std::string& directory);
+};
+
+
+// Writes MNIST-shaped IDX files under the usual names into directory, creating it if
+// needed. Every class is a fixed random 28x28 template and each image is its template
+// plus uniform noise, so the data is learnable but not trivially separable; the same
+// seed always gives the same files.
+MnistFiles writeSyntheticMnist(const std::string& directory, int trainCount, int testCount, unsigned seed);
+
+
+}
@@ -0,0 +1,350 @@
+#include "pch.h"
+#include "NN.h"
+#include "Simd.h"
+#include "FastMath.h"
+#include "Synthetic.h"
+#include <cstdio>
+#include <exception>
+
+
+// Command-line trainer for the CPU core: trains nn::Network on MNIST IDX files (or
+// generated look-alikes), reports progress and finishes with a test pass. With --json
+// every report is one JSON object per line.
+
+
+static const char* USAGE =
+    "usage: genn-train [options]\n"
+    "  --data DIR                directory holding the four MNIST IDX files (default .)\n"
+    "  --synthetic N             first write N synthetic training and N/6 test images into DIR\n"
+    "  --samples N               training samples to run (default: one epoch)\n"
+    "  --batch N                 minibatch size (default 50)\n"
+    "  --threads N               training threads (default 1)\n"
+    "  --lr X                    learning rate (default 0.01)\n"
+    "  --layers SPEC             layer widths and activations, e.g. 128:relu,64:gelu,10\n"
+    "                            (sigmoid, linear, relu, leakyrelu, gelu, tanh; default 64,64,10);\n"
+    "                            other than sigmoid, use --optimizer adam or --lr 0.001 with sgd\n"
+    "  --optimizer NAME          sgd, momentum, adam or adamw (default sgd)\n"
+    "  --precision NAME          fp32, bf16 or fp16 weight storage (default fp32)\n"
+    "  --simd NAME               scalar, avx2 or avx512; capped at what the CPU supports\n"
+    "  --fast-math               fast-math activation and loss kernels instead of libm\n"
+    "  --seed N                  initialization and shuffling seed\n"
+    "  --checkpoint FILE         write a checkpoint at the end and every --checkpoint-interval samples\n"
+    "  --checkpoint-interval N   samples between automatic checkpoints (default 0, off)\n"
+    "  --resume FILE             continue the run stored in a checkpoint, with its optimizer\n"
+    "  --report N                progress report every N samples (default 10000)\n"
+    "  --profile                 per-layer, per-phase timings at the end (needs GENN_PROFILE)\n"
+    "  --trace FILE              Chrome trace of the last 65536 profiled events (needs GENN_PROFILE)\n"
+    "  --json                    machine-readable output, one JSON object per line\n";
+
+
+struct Options {
+    std::string data = ".";
+    int synthetic = 0;
+    long long samples = 0;
+    int batch = 50;
+    int threads = 1;
+    float lr = 0.01f;
+    std::string layers;
+    std::string optimizer = "sgd";
+    std::string precision = "fp32";
+    std::string simd;
+    bool fastMath = false;
+    long long seed = -1;
+    std::string checkpoint;
+    long long checkpointInterval = 0;
+    std::string resume;
+    long long report = 10000;
+    bool profile = false;
+    std::string trace;
+    bool json = false;
+};
+
+
+static Options parse(int argc, char** argv) {
+    Options o;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--json") {
+            o.json = true;
+            continue;
+        }
+        if (arg == "--profile") {
+            o.profile = true;
+            continue;
+        }
+        if (arg == "--fast-math") {
+            o.fastMath = true;
+            continue;
+        }
+        if (arg == "--help" || arg == "-h")
+            throw std::invalid_argument("");
+        std::string v = i + 1 < argc ? argv[++i] : "";
+        bool known = true;
+        try {
+            if (arg == "--data") o.data = v;
+            else if (arg == "--synthetic") o.synthetic = std::stoi(v);
+            else if (arg == "--samples") o.samples = std::stoll(v);
+            else if (arg == "--batch") o.batch = std::stoi(v);
+            else if (arg == "--threads") o.threads = std::stoi(v);
+            else if (arg == "--lr") o.lr = std::stof(v);
+            else if (arg == "--layers") o.layers = v;
+            else if (arg == "--optimizer") o.optimizer = v;
+            else if (arg == "--precision") o.precision = v;
+            else if (arg == "--simd") o.simd = v;
+            else if (arg == "--seed") o.seed = std::stoll(v);
+            else if (arg == "--checkpoint") o.checkpoint = v;
+            else if (arg == "--checkpoint-interval") o.checkpointInterval = std::stoll(v);
+            else if (arg == "--resume") o.resume = v;
+            else if (arg == "--report") o.report = std::stoll(v);
+            else if (arg == "--trace") o.trace = v;
+            else known = false;
+        }
+        catch (const std::logic_error&) {
+            v.clear();
+        }
+        if (!known)
+            throw std::invalid_argument("unknown option " + arg);
+        if (v.empty())
+            throw std::invalid_argument("missing or invalid value for " + arg);
+    }
+    if (o.batch <= 0 || o.threads <= 0 || o.report <= 0 || o.samples < 0)
+        throw std::invalid_argument("--batch, --threads and --report must be positive");
+    return o;
+}
+
+
+static cpu::Optimizer* makeOptimizer(const std::string& name, float lr) {
+    if (name == "sgd")
+        return new cpu::Sgd(lr);
+    if (name == "momentum")
+        return new cpu::Sgd(lr, 0.9f);
+    if (name == "adam")
+        return new cpu::Adam(lr);
+    if (name == "adamw")
+        return new cpu::Adam(lr, true);
+    throw std::invalid_argument("unknown optimizer " + name);
+}
+
+
+static std::string describeOptimizer(const cpu::Optimizer& optimizer) {
+    cpu::OptimizerConfig c = optimizer.config();
+    if (c.kind == cpu::OptimizerConfig::adam)
+        return c.decoupled ? "adamw" : "adam";
+    return c.momentum != 0.0f ? "momentum" : "sgd";
+}
+
+
+static cpu::Precision parsePrecision(const std::string& name) {
+    if (name == "fp32")
+        return cpu::Precision::fp32;
+    if (name == "bf16")
+        return cpu::Precision::bf16;
+    if (name == "fp16")
+        return cpu::Precision::fp16;
+    throw std::invalid_argument("unknown precision " + name);
+}
+
+
+static void setSimd(const std::string& name) {
+    if (name.empty())
+        return;
+    if (name == "scalar")
+        cpu::simd::setLevel(cpu::simd::scalar);
+    else if (name == "avx2")
+        cpu::simd::setLevel(cpu::simd::avx2);
+    else if (name == "avx512")
+        cpu::simd::setLevel(cpu::simd::avx512);
+    else
+        throw std::invalid_argument("unknown SIMD level " + name);
+}
+
+
+static const char* simdName(cpu::simd::Level level) {
+    switch (level) {
+    case cpu::simd::avx512:
+        return "avx512";
+    case cpu::simd::avx2:
+        return "avx2";
+    default:
+        return "scalar";
+    }
+}
+
+
+static void report(const Options& o, nn::Network& net, double seconds, long long start) {
+    nn::TelemetrySnapshot s = net.telemetry.snapshot();
+    double rate = seconds > 0 ? (s.position - start) / seconds : 0;
+    if (o.json) {
+        printf("{\"event\": \"progress\", \"samples\": %lld, \"epoch\": %d, \"seconds\": %.3f, \"samples_per_second\": %.1f, "
+            "\"mean_loss\": %.6f, \"train_accuracy\": %.6f}\n",
+            s.position, s.epoch, seconds, rate, s.meanLoss, s.accuracy());
+    }
+    else {
+        printf("samples %10lld  epoch %3d  %8.0f samples/s  loss %.4f  train accuracy %.4f\n",
+            s.position, s.epoch, rate, s.meanLoss, s.accuracy());
+    }
+    fflush(stdout);
+}
+
+
+static void printProfile(const Options& o, const cpu::Profiler& profiler) {
+    for (auto& e : profiler.snapshot()) {
+        if (o.json) {
+            printf("{\"event\": \"profile\", \"layer\": %d, \"phase\": \"%s\", \"calls\": %lld, \"seconds\": %.6f, "
+                "\"gflops\": %.3f, \"gbps\": %.3f, \"p50_us\": %.3f, \"p99_us\": %.3f}\n",
+                e.layer, cpu::phaseName(e.phase), e.calls, e.seconds, e.gflops(), e.gbps(), e.percentile(0.5) * 1e6, e.percentile(0.99) * 1e6);
+        }
+        else {
+            std::string layer = e.layer < 0 ? "network" : "layer " + std::to_string(e.layer);
+            printf("%-9s %-9s %9lld calls %9.4f s %8.2f GFLOP/s %8.2f GB/s  p50 %9.2f us  p99 %9.2f us\n",
+                layer.c_str(), cpu::phaseName(e.phase), e.calls, e.seconds, e.gflops(), e.gbps(),
+                e.percentile(0.5) * 1e6, e.percentile(0.99) * 1e6);
+        }
+    }
+}
+
+
+static std::string describeTopology(const nn::Network& net) {
+    std::string s = std::to_string(net.inputSize);
+    for (auto& layer : net.topology) {
+        s += "-" + std::to_string(layer.outputs) + ":" + cpu::activationName(layer.activation);
+    }
+    return s;
+}
+
+
+static int run(const Options& o) {
+    if ((o.profile || !o.trace.empty()) && !cpu::Profiler::compiledIn())
+        throw std::invalid_argument("--profile and --trace need a build with GENN_PROFILE");
+    setSimd(o.simd);
+    cpu::fastmath::setEnabled(o.fastMath);
+    if (o.synthetic > 0) {
+        tools::writeSyntheticMnist(o.data, o.synthetic, std::max(1, o.synthetic / 6), o.seed < 0 ? 1 : static_cast<unsigned>(o.seed));
+    }
+    tools::MnistFiles files(o.data);
+    auto loadStart = std::chrono::steady_clock::now();
+    nn::ImageSet images(std::make_shared<const IdxFile>(files.trainImages));
+    std::vector<int> labels = readIdxLabels(files.trainLabels);
+    nn::ImageSet testImages(std::make_shared<const IdxFile>(files.testImages));
+    std::vector<int> testLabels = readIdxLabels(files.testLabels);
+    double loadSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - loadStart).count();
+
+    nn::Network net;
+    net.batchSize = o.batch;
+    net.threads = o.threads;
+    net.learningRate = o.lr;
+    net.precision = parsePrecision(o.precision);
+    if (!o.layers.empty()) {
+        net.topology = nn::parseTopology(o.layers);
+    }
+    if (o.seed >= 0) {
+        net.seed = static_cast<unsigned>(o.seed);
+    }
+    net.optimizer.reset(makeOptimizer(o.optimizer, o.lr));
+    net.checkpointPath = o.checkpoint;
+    net.checkpointInterval = o.checkpoint.empty() ? 0 : o.checkpointInterval;
+    net.setTrainData(images, labels);
+    net.setTestData(testImages, testLabels);
+    if (!o.resume.empty()) {
+        net.restore(nn::Checkpoint(o.resume));
+    }
+
+    long long start = net.telemetry.snapshot().position;
+    long long target = start + (o.samples > 0 ? o.samples : images.size());
+    if (o.json) {
+        printf("{\"event\": \"start\", \"train_images\": %d, \"test_images\": %d, \"load_seconds\": %.3f, \"simd\": \"%s\", "
+            "\"threads\": %d, \"batch\": %d, \"layers\": \"%s\", \"optimizer\": \"%s\", \"precision\": \"%s\", \"position\": %lld}\n",
+            images.size(), testImages.size(), loadSeconds, simdName(cpu::simd::level()), net.threads, net.batchSize,
+            describeTopology(net).c_str(), describeOptimizer(*net.optimizer).c_str(), o.precision.c_str(), start);
+    }
+    else {
+        printf("%d training and %d test images loaded in %.2f s; simd %s, %d threads, batch %d, layers %s, %s, %s\n",
+            images.size(), testImages.size(), loadSeconds, simdName(cpu::simd::level()), net.threads, net.batchSize,
+            describeTopology(net).c_str(), describeOptimizer(*net.optimizer).c_str(), o.precision.c_str());
+    }
+
+    if (!o.trace.empty()) {
+        net.profiler.startTrace();
+    }
+    std::exception_ptr failure;
+    std::atomic<bool> done{ false };
+    bool resume = !o.resume.empty();
+    auto trainStart = std::chrono::steady_clock::now();
+    std::thread trainer([&] {
+        try {
+            if (resume)
+                net.resumeTraining();
+            else
+                net.startTraining();
+        }
+        catch (...) {
+            failure = std::current_exception();
+        }
+        done = true;
+    });
+
+    long long nextReport = start + o.report;
+    while (!done) {
+        long long position = net.telemetry.snapshot().position;
+        if (position >= target)
+            break;
+        if (position >= nextReport) {
+            report(o, net, std::chrono::duration<double>(std::chrono::steady_clock::now() - trainStart).count(), start);
+            nextReport = position / o.report * o.report + o.report;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    net.stopTraining();
+    trainer.join();
+    double trainSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - trainStart).count();
+    if (failure)
+        std::rethrow_exception(failure);
+    report(o, net, trainSeconds, start);
+    net.profiler.stopTrace();
+    if (o.profile) {
+        printProfile(o, net.profiler);
+    }
+    if (!o.trace.empty()) {
+        net.profiler.writeChromeTrace(o.trace);
+    }
+
+    if (!o.checkpoint.empty()) {
+        net.saveCheckpoint(o.checkpoint);
+        net.waitCheckpoint();
+    }
+    auto testStart = std::chrono::steady_clock::now();
+    float accuracy = net.test(testImages.size());
+    double testSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - testStart).count();
+    long long trained = net.telemetry.snapshot().position - start;
+    if (o.json) {
+        printf("{\"event\": \"result\", \"samples\": %lld, \"train_seconds\": %.3f, \"samples_per_second\": %.1f, "
+            "\"test_accuracy\": %.6f, \"test_seconds\": %.3f, \"test_images_per_second\": %.1f}\n",
+            trained, trainSeconds, trained / trainSeconds, accuracy, testSeconds, testImages.size() / testSeconds);
+    }
+    else {
+        printf("trained %lld samples in %.2f s (%.0f samples/s); test accuracy %.4f in %.3f s\n",
+            trained, trainSeconds, trained / trainSeconds, accuracy, testSeconds);
+    }
+    return 0;
+}
+
+
+int main(int argc, char** argv) {
+    Options o;
+    try {
+        o = parse(argc, argv);
+    }
+    catch (const std::exception& e) {
+        if (e.what()[0] != '\0')
+            fprintf(stderr, "genn-train: %s\n", e.what());
+        fputs(USAGE, stderr);
+        return 2;
+    }
+    try {
+        return run(o);
+    }
+    catch (const std::exception& e) {
+        fprintf(stderr, "genn-train: %s\n", e.what());
+        return 1;
+    }
+}